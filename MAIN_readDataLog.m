@@ -1,5 +1,7 @@
 % MAIN_readDataLog
 %
+% The simulation writes a binary logFile.traj. Convert it first with
+%     ./traj2csv.out logFile.traj logFile.csv
 %
 
 
@@ -1,8 +1,35 @@
 #ifndef __RK2_H__
 #define __RK2_H__
 
-#include "integrator.h"
+#include "tableau.h"
 
-void rk2step(DynFun dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim);
+/* 4th-Order Explicit "Classical" Runge-Kutta Method */
 
-#endif
\ No newline at end of file
+template <class Real>
+struct RK2__Coefficients {
+	static constexpr int nStage = 2;
+
+	/* Time-step coefficients */
+	static constexpr Real A[] = {0.0L, 0.5L};
+
+	/* Solution weighting coefficients */
+	static constexpr Real C[] = {0.0L, 1.0L};
+
+	/* Simulation weighting coefficients */
+	static constexpr Real B[] = {0.5L};
+};
+
+typedef RK2__Coefficients<double> RK2__Tableau;
+
+/* Actual integration step happens here */
+template <class Dyn>
+void rk2step(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+             StepperWorkspace& work) {
+	RK_STEP_FIXED<RK2__Tableau>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work);
+}
+
+/* Compiled once, in RK_2.cpp, for plain function pointers */
+extern template void rk2step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                     StepperWorkspace&);
+
+#endif
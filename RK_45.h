@@ -1,8 +1,96 @@
 #ifndef __RK45_H__
 #define __RK45_H__
 
-#include "integrator.h"
+#include "tableau.h"
 
-void rk45step(DynFun dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim);
+/* Runge-Kutta-Fehlberg 
+ * https://en.wikipedia.org/wiki/Runge%E2%80%93Kutta%E2%80%93Fehlberg_method
+ */
+template <class Real>
+struct RK45__Coefficients {
+	static constexpr int nStage = 6;
 
-#endif
\ No newline at end of file
+	static constexpr Real A[] = {
+		0.0L,
+		1.0L / 4.0L,
+		3.0L / 8.0L,
+		12.0L / 13.0L,
+		1.0L,
+		1.0L / 2.0L
+	};
+
+	static constexpr Real C[] = {
+		16.0L / 135.0L,
+		0.0L,
+		6656.0L / 12825.0L,
+		28561.0L / 56430.0L,
+		-9.0L / 50.0L,
+		2.0L / 55.0L
+	};
+
+	/* Error weights: 5th-order minus embedded 4th-order solution weights */
+	static constexpr Real E[] = {
+		1.0L / 360.0L,
+		0.0L,
+		-128.0L / 4275.0L,
+		-2197.0L / 75240.0L,
+		1.0L / 50.0L,
+		2.0L / 55.0L
+	};
+
+	static constexpr Real B[] = {
+		1.0L / 4.0L,
+		3.0L / 32.0L,			9.0L / 32.0L,
+		1932.0L / 2197.0L,	-7200.0L / 2197.0L,	7296.0L / 2197.0L,
+		439.0L / 216.0L,		-8.0L,				3680.0L / 513.0L,		-845.0L / 4104.0L,
+		-8.0L / 27.0L,		2.0L,				-3544.0L / 2565.0L,	1859.0L / 4104.0L,	-11.0L / 40.0L
+	};
+
+	/* Continuous extension, for dense output. The solution at tLow + theta*dt is
+	 *     zLow + dt * sum_i b_i(theta) * f_i,
+	 *     b_i(theta) = D[4i]*theta + D[4i+1]*theta^2 + D[4i+2]*theta^3 + D[4i+3]*theta^4
+	 * where f_6 = f(tUpp, zUpp). It is 4th order for every theta in [0, 1],
+	 * and matches the derivative at both ends of the step. Solved from the
+	 * order conditions; the one free coefficient (theta^4 of b_5) was picked
+	 * to keep the 5th-order error terms small. */
+	static constexpr int nDense = 7;
+	static constexpr Real D[] = {
+		1.0L,	-907.0L / 360.0L,	1357.0L / 540.0L,	-7.0L / 8.0L,
+		0.0L,	0.0L,	0.0L,	0.0L,
+		0.0L,	22016.0L / 4275.0L,	-105472.0L / 12825.0L,	1024.0L / 285.0L,
+		0.0L,	-248261.0L / 75240.0L,	973271.0L / 112860.0L,	-2197.0L / 456.0L,
+		0.0L,	53.0L / 50.0L,	-71.0L / 25.0L,	8.0L / 5.0L,
+		0.0L,	-104.0L / 55.0L,	216.0L / 55.0L,	-2.0L,
+		0.0L,	3.0L / 2.0L,	-4.0L,	5.0L / 2.0L
+	};
+};
+
+typedef RK45__Coefficients<double> RK45__Tableau;
+
+/* Runge-Kutta-Fehlberg Integration method
+ * tLow = time at beginning of the step
+ * tUpp = time at the end of the step
+ * zLow = state at the beginning of the step
+ * zUpp = state at the end of the step (unknown  --  Computed by this function)
+ * nDim = dimension of the state space*/
+template <class Dyn>
+void rk45step(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+              StepperWorkspace& work) {
+	RK_STEP_FIXED<RK45__Tableau>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work);
+}
+
+/* Runge-Kutta-Fehlberg step that also returns the embedded error estimate
+ * zErr = difference between the 5th- and 4th-order solutions at tUpp */
+template <class Dyn>
+void rk45stepErr(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[],
+                 double zErr[], int nDim, StepperWorkspace& work) {
+	RK_STEP_FIXED_ERR<RK45__Tableau>(dynFun, tLow, tUpp, zLow, zUpp, zErr, nDim, work);
+}
+
+/* Compiled once, in RK_45.cpp, for plain function pointers */
+extern template void rk45step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                      StepperWorkspace&);
+extern template void rk45stepErr<DynFun>(DynFun&, double, double, double[], double[],
+                                         double[], int, StepperWorkspace&);
+
+#endif
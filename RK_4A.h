@@ -1,8 +1,51 @@
 #ifndef __RK4A_H__
 #define __RK4A_H__
 
-#include "integrator.h"
+#include "tableau.h"
 
-void rk4Astep(DynFun dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim);
+/* 4th-Order Explicit "Classical" Runge-Kutta Method */
 
-#endif
\ No newline at end of file
+template <class Real>
+struct RK4A__Coefficients {
+	static constexpr int nStage = 4;
+
+	/* Time-step coefficients */
+	static constexpr Real A[] = {
+		0.0L,
+		0.5L,
+		0.5L,
+		1.0L
+	};
+
+	/* Solution weighting coefficients */
+	static constexpr Real C[] = {
+		1.0L / 6.0L,
+		1.0L / 3.0L,
+		1.0L / 3.0L,
+		1.0L / 6.0L
+	};
+
+	/* Simulation weighting coefficients */
+	static constexpr Real B[] = {
+		0.5L,
+		0.0L, 0.5L,
+		0.0L, 0.0L, 1.0L
+	};
+};
+
+typedef RK4A__Coefficients<double> RK4A__Tableau;
+
+/* Actual integration step happens here */
+template <class Dyn>
+void rk4Astep(Dyn& dynFun,
+              double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+              StepperWorkspace& work)
+{
+	RK_STEP_FIXED<RK4A__Tableau>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work);
+}
+
+/* Compiled once, in RK_4A.cpp, for plain function pointers */
+extern template void rk4Astep<DynFun>(DynFun&, double, double, double[], double[], int,
+                                      StepperWorkspace&);
+
+#endif
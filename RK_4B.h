@@ -1,8 +1,58 @@
 #ifndef __RK4B_H__
 #define __RK4B_H__
 
-#include "integrator.h"
+#include "tableau.h"
 
-void rk4Bstep(DynFun dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim);
+/* 4th-Order Explicit "3/8 Rule" Runge-Kutta Method 
+ * https://en.wikipedia.org/wiki/Runge%E2%80%93Kutta_methods
+ */
 
-#endif
\ No newline at end of file
+template <class Real>
+struct RK4B__Coefficients {
+	static constexpr int nStage = 4;
+
+	/* Time-step coefficients */
+	static constexpr Real A[] = {
+		0.0L,
+		1.0L/3.0L,
+		2.0L/3.0L,
+		1.0L
+	};
+
+	/* Solution weighting coefficients */
+	static constexpr Real C[] = {
+		1.0L / 8.0L,
+		3.0L / 8.0L,
+		3.0L / 8.0L,
+		1.0L / 8.0L
+	};
+
+	/* Simulation weighting coefficients */
+	static constexpr Real B[] = {
+		1.0L/3.0L,
+		-1.0L/3.0L, 	1.0L,
+		1.0L, 		-1.0L, 	1.0L
+	};
+};
+
+typedef RK4B__Coefficients<double> RK4B__Tableau;
+
+/* Runge-Kutta "3/8 Rule"
+ * tLow = time at beginning of the step
+ * tUpp = time at the end of the step
+ * zLow = state at the beginning of the step
+ * zUpp = state at the end of the step (unknown  --  Computed by this function)
+ * nDim = dimension of the state space*/
+template <class Dyn>
+void rk4Bstep(Dyn& dynFun,
+              double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+              StepperWorkspace& work)
+{
+	RK_STEP_FIXED<RK4B__Tableau>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work);
+}
+
+/* Compiled once, in RK_4B.cpp, for plain function pointers */
+extern template void rk4Bstep<DynFun>(DynFun&, double, double, double[], double[], int,
+                                      StepperWorkspace&);
+
+#endif
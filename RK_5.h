@@ -1,8 +1,77 @@
 #ifndef __RK5_H__
 #define __RK5_H__
 
-#include "integrator.h"
+#include "tableau.h"
 
-void rk5step(DynFun dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim);
+/* 5th-Order Explicit Runge-Kutta Method
+ * "Classical fifth-, sixth-, seventh-, and eighth-order
+ * Runge-Kutta formulas with stepsize control"
+ * By:  Erwin Fehlberg      1968
+ */
 
-#endif
\ No newline at end of file
+template <class Real>
+struct RK5__Coefficients {
+	static constexpr int nStage = 6;
+
+	/* Time-step coefficients */
+	static constexpr Real A[] = {
+		0.0L,
+		1.0L/3.0L,
+		2.0L/5.0L,
+		1.0L,
+		2.0L/3.0L,
+		4.0L/5.0L
+	};
+
+	/* Solution weighting coefficients */
+	static constexpr Real C[] = {
+		23.0L/192.0L,
+		0.0L,
+		125.0L/192.0L,
+		0.0L,
+		-27.0L/64.0L,
+		125.0L/192.0L
+	};
+
+	/* Simulation weighting coefficients */
+	static constexpr Real B[] = {
+		1.0L/3.0L,
+		4.0L/25.0L, 	6.0L/25.0L,
+		1.0L/4.0L,		-3.0L,			15.0L/4.0L,
+		2.0L/27.0L, 	10.0L/9.0L,  	-50.0L/81.0L,   8.0L/81.0L,
+		2.0L/25.0L, 	12.0L/25.0L,  	2.0L/15.0L,  	8.0L/75.0L,  0.0L
+	};
+
+	/* Dense-output weights, laid out as RK45__Tableau::D: 4th order in theta,
+	 * with f_6 = f(tUpp, zUpp). */
+	static constexpr int nDense = 7;
+	static constexpr Real D[] = {
+		1.0L,	-4029.0L / 1600.0L,	6037.0L / 2400.0L,	-351.0L / 400.0L,
+		0.0L,	0.0L,	0.0L,	0.0L,
+		0.0L,	343.0L / 64.0L,	-779.0L / 96.0L,	109.0L / 32.0L,
+		0.0L,	-93.0L / 100.0L,	93.0L / 50.0L,	-93.0L / 100.0L,
+		0.0L,	-6183.0L / 1600.0L,	4833.0L / 800.0L,	-2079.0L / 800.0L,
+		0.0L,	29.0L / 64.0L,	163.0L / 96.0L,	-3.0L / 2.0L,
+		0.0L,	3.0L / 2.0L,	-4.0L,	5.0L / 2.0L
+	};
+};
+
+typedef RK5__Coefficients<double> RK5__Tableau;
+
+/* Runge-Kutta 5th-order method
+ * tLow = time at beginning of the step
+ * tUpp = time at the end of the step
+ * zLow = state at the beginning of the step
+ * zUpp = state at the end of the step (unknown  --  Computed by this function)
+ * nDim = dimension of the state space*/
+template <class Dyn>
+void rk5step(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+             StepperWorkspace& work) {
+	RK_STEP_FIXED<RK5__Tableau>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work);
+}
+
+/* Compiled once, in RK_5.cpp, for plain function pointers */
+extern template void rk5step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                     StepperWorkspace&);
+
+#endif
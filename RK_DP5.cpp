@@ -0,0 +1,6 @@
+#include "RK_DP5.h"
+
+template void dp5step<DynFun>(DynFun&, double, double, double[], double[], int,
+                              StepperWorkspace&);
+template void dp5stepErr<DynFun>(DynFun&, double, double, double[], double[],
+                                 double[], int, StepperWorkspace&);
@@ -0,0 +1,100 @@
+#ifndef __RKDP5_H__
+#define __RKDP5_H__
+
+#include "tableau.h"
+
+/* Dormand-Prince 5(4)
+ * "A family of embedded Runge-Kutta formulae"
+ * By:  J. R. Dormand and P. J. Prince      1980
+ *
+ * The last stage is evaluated at the new solution (the last row of B is C),
+ * so it doubles as the first stage of the next step: 6 new dynamics
+ * evaluations per step instead of 7 (see StepperWorkspace::reuseLastStage).
+ */
+template <class Real>
+struct DP5__Coefficients {
+	static constexpr int nStage = 7;
+
+	static constexpr Real A[] = {
+		0.0L,
+		1.0L / 5.0L,
+		3.0L / 10.0L,
+		4.0L / 5.0L,
+		8.0L / 9.0L,
+		1.0L,
+		1.0L
+	};
+
+	static constexpr Real C[] = {
+		35.0L / 384.0L,
+		0.0L,
+		500.0L / 1113.0L,
+		125.0L / 192.0L,
+		-2187.0L / 6784.0L,
+		11.0L / 84.0L,
+		0.0L
+	};
+
+	/* Error weights: 5th-order minus embedded 4th-order solution weights */
+	static constexpr Real E[] = {
+		71.0L / 57600.0L,
+		0.0L,
+		-71.0L / 16695.0L,
+		71.0L / 1920.0L,
+		-17253.0L / 339200.0L,
+		22.0L / 525.0L,
+		-1.0L / 40.0L
+	};
+
+	static constexpr Real B[] = {
+		1.0L / 5.0L,
+		3.0L / 40.0L,			9.0L / 40.0L,
+		44.0L / 45.0L,		-56.0L / 15.0L,		32.0L / 9.0L,
+		19372.0L / 6561.0L,	-25360.0L / 2187.0L,	64448.0L / 6561.0L,	-212.0L / 729.0L,
+		9017.0L / 3168.0L,	-355.0L / 33.0L,		46732.0L / 5247.0L,	49.0L / 176.0L,	-5103.0L / 18656.0L,
+		35.0L / 384.0L,		0.0L,				500.0L / 1113.0L,		125.0L / 192.0L,	-2187.0L / 6784.0L,	11.0L / 84.0L
+	};
+
+	/* Dense-output weights, laid out as RK45__Tableau::D. The 7th stage is
+	 * already f(tUpp, zUpp), so interpolation costs no extra evaluation. */
+	static constexpr int nDense = 7;
+	static constexpr Real D[] = {
+		1.0L,	-183.0L / 64.0L,	37.0L / 12.0L,	-145.0L / 128.0L,
+		0.0L,	0.0L,	0.0L,	0.0L,
+		0.0L,	1500.0L / 371.0L,	-1000.0L / 159.0L,	1000.0L / 371.0L,
+		0.0L,	-125.0L / 32.0L,	125.0L / 12.0L,	-375.0L / 64.0L,
+		0.0L,	9477.0L / 3392.0L,	-729.0L / 106.0L,	25515.0L / 6784.0L,
+		0.0L,	-11.0L / 7.0L,	11.0L / 3.0L,	-55.0L / 28.0L,
+		0.0L,	3.0L / 2.0L,	-4.0L,	5.0L / 2.0L
+	};
+};
+
+typedef DP5__Coefficients<double> DP5__Tableau;
+
+/* Dormand-Prince 5th-order step
+ * tLow = time at beginning of the step
+ * tUpp = time at the end of the step
+ * zLow = state at the beginning of the step
+ * zUpp = state at the end of the step (unknown  --  Computed by this function)
+ * nDim = dimension of the state space*/
+template <class Dyn>
+void dp5step(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+             StepperWorkspace& work) {
+	RK_STEP_FIXED<DP5__Tableau>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work);
+}
+
+/* Dormand-Prince step that also returns the embedded error estimate
+ * zErr = difference between the 5th- and 4th-order solutions at tUpp */
+template <class Dyn>
+void dp5stepErr(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[],
+                double zErr[], int nDim, StepperWorkspace& work) {
+	RK_STEP_FIXED_ERR<DP5__Tableau>(dynFun, tLow, tUpp, zLow, zUpp, zErr, nDim, work);
+}
+
+/* Compiled once, in RK_DP5.cpp, for plain function pointers */
+extern template void dp5step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                     StepperWorkspace&);
+extern template void dp5stepErr<DynFun>(DynFun&, double, double, double[], double[],
+                                        double[], int, StepperWorkspace&);
+
+#endif
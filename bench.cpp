@@ -0,0 +1,267 @@
+/* Benchmark suite: every IntegrationMethod on a set of standard problems.
+ *
+ *     make bench              (builds bench.out and writes bench.csv)
+ *     ./bench.out [quick]     (CSV on stdout; "quick" = smaller sizes and
+ *                              shorter timings, for regression checks)
+ *
+ * One CSV row per run:
+ *     problem, nDim, method, mode, setting, steps, seconds, nsPerStep,
+ *     rhsPerStep, error
+ * mode is "fixed" (setting = nStep) or "adaptive" (setting = relTol = absTol).
+ * error is the max-norm of the final state error, relative to the largest
+ * component of the reference solution, and inf for a run that diverged
+ * (a state that is not finite). The rows of one problem and method,
+ * read in order of setting, are its work-precision curve (error against
+ * seconds or against steps * rhsPerStep).
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "integrator.h"
+
+static const IntegrationMethod ALL_METHODS[] = {
+	Euler, MidPoint, RungeKutta, RK_2, RK_4A, RK_4B, RK_45, RK_5, RK_10, RK_DP5,
+	StormerVerlet, Yoshida4, Yoshida6, Yoshida8, BlanesMoan, SDIRK_3, RADAU_5, BDF_2, BDF_5,
+	LSRK_3, LSRK_4, SSPRK_3, SSPRK_4, ARK_4
+};
+
+/* Largest state the implicit methods run on with dense Newton matrices */
+static const int MAX_DENSE_IMPLICIT = 256;
+
+struct BenchOptions {
+	double minSeconds;           // repeat each run until it has taken this long
+	std::vector<int> nStep;      // fixed-step ladder
+	std::vector<double> tol;     // adaptive ladder
+	int nRef;                    // RK_10 steps for the reference solutions
+};
+
+static double seconds() {
+	return std::chrono::duration<double>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* Infinite if the run diverged (std::max would drop a NaN) */
+static double relativeError(const std::vector<double>& z, const std::vector<double>& zRef) {
+	double err = 0.0, scale = 1e-300;
+	for (size_t i = 0; i < z.size(); i++) {
+		if (!std::isfinite(z[i])) {
+			return INFINITY;
+		}
+		err = std::max(err, std::fabs(z[i] - zRef[i]));
+		scale = std::max(scale, std::fabs(zRef[i]));
+	}
+	return err / scale;
+}
+
+static void printRow(const char* problem, int nDim, IntegrationMethod method, const char* mode,
+                     double setting, long long steps, double time, double rhsPerStep, double error)
+{
+	std::printf("%s,%d,%s,%s,%g,%lld,%.6e,%.2f,%.3f,%.3e\n", problem, nDim, methodName(method),
+	            mode, setting, steps, time, 1e9 * time / steps, rhsPerStep, error);
+	std::fflush(stdout);
+}
+
+/* Runs every method on one problem. zRef = final state at t1 (empty: from
+ * a fine RK_10 run). The symplectic methods only run on separable problems
+ * (z = [q; p], see symplectic.h), the implicit ones with the bandwidths in
+ * implicit (see implicit.h) and, without them, only on small problems. */
+template <class Dyn>
+void benchProblem(const char* name, Dyn dynFun, double t1, std::vector<double> z0,
+                  std::vector<double> zRef, bool separable, const ImplicitOptions& implicit,
+                  const BenchOptions& options)
+{
+	int nDim = (int) z0.size();
+	std::vector<double> z1(nDim);
+	NullSink noLog;
+
+	if (zRef.empty()) {
+		zRef.resize(nDim);
+		simulate(dynFun, 0.0, t1, z0.data(), zRef.data(), nDim, options.nRef, RK_10, noLog);
+	}
+
+	long long nEval = 0;
+	auto counted = [&](double t, double z[], double dz[]) {
+		nEval++;
+		dynFun(t, z, dz);
+	};
+
+	for (IntegrationMethod method : ALL_METHODS) {
+		if (isSymplectic(method) && !separable) {
+			continue;
+		}
+		if (isImplicit(method) && implicit.lower < 0 && nDim > MAX_DENSE_IMPLICIT) {
+			continue;
+		}
+
+		/// Fixed steps:
+		for (int nStep : options.nStep) {
+			int nRep = 0;
+			nEval = 0;
+			double tStart = seconds(), elapsed;
+			do {
+				simulate(stiffDynamics(std::ref(counted), implicit), 0.0, t1, z0.data(), z1.data(), nDim,
+				         nStep, method, noLog);
+				nRep++;
+				elapsed = seconds() - tStart;
+			} while (elapsed < options.minSeconds);
+			double error = relativeError(z1, zRef);
+			printRow(name, nDim, method, "fixed", nStep, nStep, elapsed / nRep,
+			         (double) nEval / ((double) nStep * nRep), error);
+		}
+
+		/// Variable steps:
+		if (!hasErrorEstimate(method)) {
+			continue;
+		}
+		for (double tol : options.tol) {
+			AdaptiveOptions adaptive;
+			adaptive.relTol = tol;
+			adaptive.absTol = tol;
+			AdaptiveStats stats;
+			int nRep = 0;
+			double tStart = seconds(), elapsed;
+			do {
+				stats = simulateAdaptive(std::ref(counted), 0.0, t1, z0.data(), z1.data(), nDim,
+				                         method, adaptive, noLog);
+				nRep++;
+				elapsed = seconds() - tStart;
+			} while (elapsed < options.minSeconds);
+			long long steps = stats.nAccept + stats.nReject;
+			printRow(name, nDim, method, "adaptive", tol, steps, elapsed / nRep,
+			         (double) stats.nEval / steps, relativeError(z1, zRef));
+		}
+	}
+}
+
+
+/******************************************************************************
+ *                              Problems                                      *
+ ******************************************************************************/
+
+/* Damped pendulum, as in main.cpp */
+static void benchPendulum(const BenchOptions& options) {
+	auto pendulum = [](double, double z[], double dz[]) {
+		dz[0] = z[1];
+		dz[1] = -0.1 * z[1] - std::sin(z[0]);
+	};
+	benchProblem("pendulum", pendulum, 20.0, {1.9, -4.5}, {}, false, ImplicitOptions(), options);
+}
+
+/* Lorenz system, over a horizon short enough for the chaos to stay
+ * resolvable at every tolerance */
+static void benchLorenz(const BenchOptions& options) {
+	auto lorenz = [](double, double z[], double dz[]) {
+		dz[0] = 10.0 * (z[1] - z[0]);
+		dz[1] = z[0] * (28.0 - z[2]) - z[1];
+		dz[2] = z[0] * z[1] - (8.0 / 3.0) * z[2];
+	};
+	benchProblem("lorenz", lorenz, 2.0, {1.0, 1.0, 1.0}, {}, false, ImplicitOptions(), options);
+}
+
+/* N-body gravity (G = 1): a unit central mass with nPlanet light planets on
+ * slightly eccentric, inclined orbits, for one period of the innermost.
+ * State = positions of all bodies, then velocities (nDim = 6 * nBody). */
+static void benchNBody(int nPlanet, const BenchOptions& options) {
+	int nBody = nPlanet + 1;
+	std::vector<double> mass(nBody, 1e-3);
+	mass[0] = 1.0;
+
+	std::vector<double> z0(6 * nBody, 0.0);
+	double *x = &z0[0], *v = &z0[3 * nBody];
+	for (int i = 1; i < nBody; i++) {
+		double r = 1.0 + 0.5 * (i - 1);
+		double phase = 2.4 * i;
+		x[3*i] = r * std::cos(phase);
+		x[3*i+1] = r * std::sin(phase);
+		x[3*i+2] = 0.01 * r * std::sin(3.0 * phase);
+		double speed = 1.05 * std::sqrt(1.0 / r);
+		v[3*i] = -speed * std::sin(phase);
+		v[3*i+1] = speed * std::cos(phase);
+	}
+
+	auto gravity = [nBody, mass](double, double z[], double dz[]) {
+		const double *x = z, *v = z + 3 * nBody;
+		double *dx = dz, *dv = dz + 3 * nBody;
+		for (int k = 0; k < 3 * nBody; k++) {
+			dx[k] = v[k];
+			dv[k] = 0.0;
+		}
+		for (int i = 0; i < nBody; i++) {
+			for (int j = i + 1; j < nBody; j++) {
+				double d[3], r2 = 0.0;
+				for (int k = 0; k < 3; k++) {
+					d[k] = x[3*j+k] - x[3*i+k];
+					r2 += d[k] * d[k];
+				}
+				double inv3 = 1.0 / (r2 * std::sqrt(r2));
+				for (int k = 0; k < 3; k++) {
+					dv[3*i+k] += mass[j] * inv3 * d[k];
+					dv[3*j+k] -= mass[i] * inv3 * d[k];
+				}
+			}
+		}
+	};
+	char name[32];
+	std::snprintf(name, sizeof(name), "nbody%d", nBody);
+	benchProblem(name, gravity, 2.0 * M_PI, z0, {}, true, ImplicitOptions(), options);
+}
+
+/* Linear diffusion on n points with zero boundary values,
+ *     dz[i] = nu * (z[i-1] - 2 z[i] + z[i+1]),   nu = 1/4
+ * so the stiffest mode (eigenvalue ~ -1) is stable for every ladder step.
+ * Starts from a sum of three sine modes; each decays exactly as
+ * exp(-4 nu sin^2(k pi / (2(n+1))) t), which gives the reference. */
+static void benchDiffusion(int n, const BenchOptions& options) {
+	const double nu = 0.25, t1 = 10.0;
+	const int mode[3] = {1, n / 8 + 1, n / 4 + 1};
+	std::vector<double> z0(n, 0.0), zRef(n, 0.0);
+	for (int m = 0; m < 3; m++) {
+		double s = std::sin(mode[m] * M_PI / (2.0 * (n + 1)));
+		double decay = std::exp(-4.0 * nu * s * s * t1);
+		for (int i = 0; i < n; i++) {
+			double shape = std::sin(mode[m] * M_PI * (i + 1) / (n + 1));
+			z0[i] += shape;
+			zRef[i] += decay * shape;
+		}
+	}
+
+	auto diffusion = [n, nu](double, double z[], double dz[]) {
+		dz[0] = nu * (-2.0 * z[0] + z[1]);
+		for (int i = 1; i < n - 1; i++) {
+			dz[i] = nu * (z[i-1] - 2.0 * z[i] + z[i+1]);
+		}
+		dz[n-1] = nu * (z[n-2] - 2.0 * z[n-1]);
+	};
+	ImplicitOptions implicit;
+	implicit.lower = implicit.upper = 1;   // tridiagonal
+	char name[32];
+	std::snprintf(name, sizeof(name), "diffusion%d", n);
+	benchProblem(name, diffusion, t1, z0, zRef, false, implicit, options);
+}
+
+
+int main(int argc, char* argv[]) {
+	bool quick = argc > 1 && std::strcmp(argv[1], "quick") == 0;
+
+	BenchOptions options;
+	options.minSeconds = quick ? 0.002 : 0.05;
+	options.nStep = quick ? std::vector<int>{50, 200} : std::vector<int>{50, 100, 200, 400, 800, 1600};
+	options.tol = quick ? std::vector<double>{1e-4, 1e-8} : std::vector<double>{1e-3, 1e-5, 1e-7, 1e-9, 1e-11};
+	options.nRef = 20000;
+
+	std::printf("problem,nDim,method,mode,setting,steps,seconds,nsPerStep,rhsPerStep,error\n");
+	benchPendulum(options);
+	benchLorenz(options);
+	benchNBody(4, options);
+	benchNBody(quick ? 8 : 16, options);
+	benchDiffusion(64, options);
+	benchDiffusion(quick ? 1024 : 4096, options);
+	if (!quick) {
+		benchDiffusion(65536, options);
+	}
+	return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef __BYTEORDER_H__
+#define __BYTEORDER_H__
+
+#include <cstdint>
+#include <cstring>
+
+/* Little-endian packing for the binary file formats (trajectory.h,
+ * checkpoint.h) */
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static const bool BIG_ENDIAN_HOST = true;
+#else
+static const bool BIG_ENDIAN_HOST = false;
+#endif
+
+inline void putU32(unsigned char* p, uint32_t x) {
+	for (int k = 0; k < 4; k++) {
+		p[k] = (unsigned char) (x >> (8 * k));
+	}
+}
+
+inline uint32_t getU32(const unsigned char* p) {
+	uint32_t x = 0;
+	for (int k = 0; k < 4; k++) {
+		x |= (uint32_t) p[k] << (8 * k);
+	}
+	return x;
+}
+
+inline void putU64(unsigned char* p, uint64_t x) {
+	for (int k = 0; k < 8; k++) {
+		p[k] = (unsigned char) (x >> (8 * k));
+	}
+}
+
+inline uint64_t getU64(const unsigned char* p) {
+	uint64_t x = 0;
+	for (int k = 0; k < 8; k++) {
+		x |= (uint64_t) p[k] << (8 * k);
+	}
+	return x;
+}
+
+inline void putF64(unsigned char* p, double x) {
+	uint64_t bits;
+	std::memcpy(&bits, &x, sizeof(bits));
+	putU64(p, bits);
+}
+
+inline double getF64(const unsigned char* p) {
+	uint64_t bits = getU64(p);
+	double x;
+	std::memcpy(&x, &bits, sizeof(x));
+	return x;
+}
+
+inline double swapBytes(double x) {
+	uint64_t bits;
+	std::memcpy(&bits, &x, sizeof(bits));
+	bits = __builtin_bswap64(bits);
+	std::memcpy(&x, &bits, sizeof(x));
+	return x;
+}
+
+#endif
@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include "byteorder.h"
+#include "checkpoint.h"
+
+static const char CHECKPOINT_MAGIC[8] = {'R', 'K', 'C', 'K', 'P', 'T', 0, 0};
+
+
+/******************************************************************************
+ *                              Checkpoint                                    *
+ ******************************************************************************/
+
+Checkpoint::Checkpoint(const std::string& fileName, double interval) :
+	fileName(fileName), interval(interval), trajectory(0), timeUp(false), armed(false),
+	haveSaved(false), busy(false), written(0), stopping(false)
+{
+	writer = std::thread(&Checkpoint::writerLoop, this);
+}
+
+Checkpoint::~Checkpoint() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	ready.notify_one();
+	writer.join();
+}
+
+bool Checkpoint::load() {
+	haveSaved = false;
+	FILE *file = std::fopen(fileName.c_str(), "rb");
+	if (!file) {
+		if (errno == ENOENT) {
+			return false;
+		}
+		throw std::runtime_error("Checkpoint: cannot open " + fileName);
+	}
+	std::vector<unsigned char> bytes;
+	unsigned char chunk[1 << 16];
+	size_t n;
+	while ((n = std::fread(chunk, 1, sizeof(chunk), file)) > 0) {
+		bytes.insert(bytes.end(), chunk, chunk + n);
+	}
+	std::fclose(file);
+
+	const std::string bad = "Checkpoint: " + fileName + " is not a checkpoint file";
+	const unsigned char *p = bytes.data();
+	if (bytes.size() < (size_t) CHECKPOINT_HEADER_SIZE
+	    || std::memcmp(p, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0) {
+		throw std::runtime_error(bad);
+	}
+	if (getU32(p + 8) != (uint32_t) CHECKPOINT_VERSION) {
+		throw std::runtime_error("Checkpoint: " + fileName + " has an unknown format version");
+	}
+
+	CheckpointState& state = savedState;
+	state.nDim = (int) getU32(p + 12);
+	state.method = (IntegrationMethod) (int32_t) getU32(p + 16);
+	state.fsalStage = (int32_t) getU32(p + 20);
+	state.nStep = (long long) getU64(p + 24);
+	state.t0 = getF64(p + 32);
+	state.t1 = getF64(p + 40);
+	state.t = getF64(p + 48);
+	state.dt = getF64(p + 56);
+	state.nAccept = (long long) getU64(p + 64);
+	state.nReject = (long long) getU64(p + 72);
+	state.nEval = (long long) getU64(p + 80);
+
+	size_t nArray = state.fsalStage >= 0 ? 2 : 1;
+	if (state.nDim < 0 || bytes.size() != CHECKPOINT_HEADER_SIZE + nArray * state.nDim * sizeof(double)) {
+		throw std::runtime_error(bad);
+	}
+	p += CHECKPOINT_HEADER_SIZE;
+	state.z.resize(state.nDim);
+	for (int i = 0; i < state.nDim; i++, p += 8) {
+		state.z[i] = getF64(p);
+	}
+	state.fsal.resize(state.fsalStage >= 0 ? state.nDim : 0);
+	for (size_t i = 0; i < state.fsal.size(); i++, p += 8) {
+		state.fsal[i] = getF64(p);
+	}
+	haveSaved = true;
+	return true;
+}
+
+bool Checkpoint::begin(IntegrationMethod method, int nDim, double t0, double t1, long long nStep) {
+	if (haveSaved && (savedState.method != method || savedState.nDim != nDim
+	                  || savedState.t0 != t0 || savedState.t1 != t1 || savedState.nStep != nStep)) {
+		throw std::invalid_argument("Checkpoint: " + fileName + " was written by a different run");
+	}
+	wait();
+	for (CheckpointState* state : {&front, &back}) {
+		state->method = method;
+		state->nDim = nDim;
+		state->t0 = t0;
+		state->t1 = t1;
+		state->nStep = nStep;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		arm();
+	}
+	ready.notify_one();
+	if (haveSaved && trajectory) {
+		trajectory->resume(savedState.t);
+	}
+	return haveSaved;
+}
+
+/* Called with the mutex held: the next checkpoint falls due interval
+ * seconds from now (never, for intervals past a century) */
+void Checkpoint::arm() {
+	timeUp.store(false, std::memory_order_relaxed);
+	armed = interval < 3.2e9;
+	if (armed) {
+		std::chrono::duration<double> wait(interval);
+		nextDue = std::chrono::steady_clock::now()
+		          + std::chrono::duration_cast<std::chrono::steady_clock::duration>(wait);
+	}
+}
+
+void Checkpoint::save(double t, const double z[], double dt, StepperWorkspace& work,
+                      long long nAccept, long long nReject, long long nEval) {
+	if (trajectory) {
+		trajectory->flush();
+	}
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [&] { return !busy.load(); });
+	throwPendingError();
+
+	/// Fill front, then swap it with back (no reallocation once both are sized):
+	int nDim = work.nDim();
+	front.t = t;
+	front.dt = dt;
+	front.nAccept = nAccept;
+	front.nReject = nReject;
+	front.nEval = nEval;
+	front.z.assign(z, z + nDim);
+
+	/// The FSAL stage, if the next step would pick it up (see reuseLastStage):
+	int iStage = work.lastStageIndex();
+	bool reusable = iStage >= 0 && work.lastStageTime() == t
+	                && std::equal(z, z + nDim, work.z(iStage));
+	front.fsalStage = reusable ? iStage : -1;
+	if (reusable) {
+		front.fsal.assign(work.f(iStage), work.f(iStage) + nDim);
+	} else {
+		front.fsal.clear();
+	}
+
+	std::swap(front, back);
+	busy.store(true);
+	arm();
+	lock.unlock();
+	ready.notify_one();
+}
+
+void Checkpoint::wait() {
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [&] { return !busy.load(); });
+	throwPendingError();
+}
+
+/* Called with the mutex held */
+void Checkpoint::throwPendingError() {
+	if (!error.empty()) {
+		std::string message;
+		message.swap(error);
+		throw std::runtime_error(message);
+	}
+}
+
+void Checkpoint::writerLoop() {
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		/// Between writes, sleep until the next checkpoint falls due (or
+		/// begin() sets a new time) and tell the step loop:
+		std::chrono::steady_clock::time_point until = nextDue;
+		bool waiting = armed;
+		auto woken = [&] { return busy.load() || stopping || armed != waiting || nextDue != until; };
+		if (waiting) {
+			ready.wait_until(lock, until, woken);
+		} else {
+			ready.wait(lock, woken);
+		}
+		if (!busy.load()) {
+			if (stopping) {
+				return;
+			}
+			if (armed && nextDue == until && std::chrono::steady_clock::now() >= until) {
+				timeUp.store(true, std::memory_order_relaxed);
+				armed = false;
+			}
+			continue;
+		}
+		lock.unlock();
+		std::string failure;
+		try {
+			writeFile(back);
+		} catch (const std::exception& e) {
+			failure = e.what();
+		}
+		lock.lock();
+		if (failure.empty()) {
+			written++;
+		} else {
+			error = failure;
+		}
+		busy.store(false);
+		done.notify_all();
+	}
+}
+
+/* Writes n doubles, little-endian; false on failure */
+static bool writeDoubles(FILE* file, const double x[], size_t n) {
+	if (!BIG_ENDIAN_HOST) {
+		return std::fwrite(x, sizeof(double), n, file) == n;
+	}
+	std::vector<double> swapped(n);
+	for (size_t i = 0; i < n; i++) {
+		swapped[i] = swapBytes(x[i]);
+	}
+	return std::fwrite(swapped.data(), sizeof(double), n, file) == n;
+}
+
+void Checkpoint::writeFile(const CheckpointState& state) {
+	unsigned char header[CHECKPOINT_HEADER_SIZE];
+	std::memset(header, 0, sizeof(header));
+	std::memcpy(header, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+	putU32(header + 8, CHECKPOINT_VERSION);
+	putU32(header + 12, state.nDim);
+	putU32(header + 16, (uint32_t) state.method);
+	putU32(header + 20, (uint32_t) state.fsalStage);
+	putU64(header + 24, (uint64_t) state.nStep);
+	putF64(header + 32, state.t0);
+	putF64(header + 40, state.t1);
+	putF64(header + 48, state.t);
+	putF64(header + 56, state.dt);
+	putU64(header + 64, (uint64_t) state.nAccept);
+	putU64(header + 72, (uint64_t) state.nReject);
+	putU64(header + 80, (uint64_t) state.nEval);
+
+	/// Write a temporary file, and replace the last checkpoint once it is on disk:
+	std::string tmpName = fileName + ".tmp";
+	FILE *file = std::fopen(tmpName.c_str(), "wb");
+	if (!file) {
+		throw std::runtime_error("Checkpoint: cannot open " + tmpName);
+	}
+	bool ok = std::fwrite(header, 1, sizeof(header), file) == sizeof(header);
+	ok = ok && writeDoubles(file, state.z.data(), state.nDim);
+	if (state.fsalStage >= 0) {
+		ok = ok && writeDoubles(file, state.fsal.data(), state.nDim);
+	}
+	ok = ok && std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+	ok = std::fclose(file) == 0 && ok;
+	if (!ok) {
+		std::remove(tmpName.c_str());
+		throw std::runtime_error("Checkpoint: cannot write " + tmpName);
+	}
+	if (std::rename(tmpName.c_str(), fileName.c_str()) != 0) {
+		throw std::runtime_error("Checkpoint: cannot replace " + fileName);
+	}
+}
+
+
+/******************************************************************************
+ *                           Stepper State                                    *
+ ******************************************************************************/
+
+void restoreStepperState(const CheckpointState& state, double z[], StepperWorkspace& work) {
+	int nDim = work.nDim();
+	std::copy(state.z.begin(), state.z.end(), z);
+	int iStage = state.fsalStage;
+	if (iStage < 0) {
+		work.clearLastStage();
+		return;
+	}
+	if (iStage >= work.nStage()) {
+		throw std::invalid_argument("Checkpoint: FSAL stage outside the workspace");
+	}
+	std::copy(z, z + nDim, work.z(iStage));
+	std::copy(state.fsal.begin(), state.fsal.end(), work.f(iStage));
+	work.setLastStage(state.t, iStage);
+}
@@ -0,0 +1,186 @@
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sink.h"
+#include "stepper.h"
+
+/* Checkpoint/restart of long runs.
+ *
+ * A Checkpoint passed to simulate or simulateAdaptive saves the state of the
+ * step loop to a file every few seconds of wall-clock time. If the process
+ * dies, the same call with a Checkpoint on the same file picks the run up
+ * from the last one:
+ *
+ *     Checkpoint checkpoint("run.ckpt", 5.0);     // at most every 5 s
+ *     simulate(dynFun, t0, t1, z0, z1, nDim, nStep, RK_DP5, sink, checkpoint);
+ *
+ * The file holds everything the next step depends on: t, z, the step size,
+ * the first-same-as-last derivative and the step counters. (The step-size
+ * controller only remembers whether its last trial step failed, which is
+ * never the case right after an accepted step.) The resumed run takes the
+ * same steps and reaches the same bits as one that was never interrupted.
+ * The implicit methods are the exception: their Newton matrices and BDF
+ * history are rebuilt, not saved, so they continue within the tolerances
+ * but not bit for bit.
+ *
+ * The sink is flushed before every checkpoint, so what it has written
+ * always reaches the last one. A resumed run passes it the steps after the
+ * checkpoint only, after resume(t) (see TrajectorySink) has dropped the
+ * steps the dead run wrote past it; a new run first drops them all. With a
+ * BinarySink in append mode on the dead run's file, the file thus ends up
+ * holding the whole trajectory once, as if the run had never stopped:
+ *
+ *     BinarySink sink("run.traj", RK_DP5, SinkAppend);
+ *
+ * A run that finishes leaves its final state in the file, so running it
+ * again does nothing but return that state.
+ *
+ * The step loop only copies its state into a buffer. A background thread
+ * writes it to fileName.tmp, syncs it and renames it over fileName, so the
+ * file is always a complete checkpoint, the new one or the one before. The
+ * same thread keeps the time: it sleeps until the next checkpoint falls due
+ * and raises a flag, which the step loop tests after every step, so the
+ * loop never reads the clock and a checkpoint is late by at most one step,
+ * however long the steps take. One that falls due while the last one is
+ * still being written waits for that write to finish.
+ *
+ * Layout (all numbers little-endian):
+ *     bytes  0 -  7   magic "RKCKPT\0\0"
+ *     bytes  8 - 11   uint32 format version (1)
+ *     bytes 12 - 15   uint32 nDim
+ *     bytes 16 - 19   int32  IntegrationMethod
+ *     bytes 20 - 23   int32  FSAL stage (-1: none)
+ *     bytes 24 - 31   int64  nStep (fixed-step runs; 0 for adaptive runs)
+ *     bytes 32 - 39   double t0
+ *     bytes 40 - 47   double t1
+ *     bytes 48 - 55   double t
+ *     bytes 56 - 63   double dt (the next trial step)
+ *     bytes 64 - 71   int64  nAccept
+ *     bytes 72 - 79   int64  nReject
+ *     bytes 80 - 87   int64  nEval
+ *     bytes 88 - 95   reserved, zero
+ * followed by z (nDim doubles) and, if there is an FSAL stage, its
+ * derivative (nDim doubles).
+ */
+
+const int CHECKPOINT_VERSION = 1;
+const int CHECKPOINT_HEADER_SIZE = 96;
+
+/* The state of a run between two steps */
+struct CheckpointState {
+	IntegrationMethod method;
+	int nDim;
+	long long nStep;        // fixed-step runs; 0 for adaptive runs
+	double t0;              // the run's interval
+	double t1;
+	double t;               // time of z
+	double dt;              // next (trial) step size
+	long long nAccept;
+	long long nReject;
+	long long nEval;
+	int fsalStage;          // -1: no stage to reuse
+	std::vector<double> z;
+	std::vector<double> fsal;   // derivative of stage fsalStage, taken at (t, z)
+
+	CheckpointState() :
+		method(Euler), nDim(0), nStep(0), t0(0.0), t1(0.0), t(0.0), dt(0.0),
+		nAccept(0), nReject(0), nEval(0), fsalStage(-1) {}
+};
+
+/* Writes checkpoints of a run to fileName, at most every interval seconds.
+ * Write errors are thrown (std::runtime_error) from the step loop's next
+ * save, so a run never goes on believing it is protected. */
+class Checkpoint {
+public:
+	explicit Checkpoint(const std::string& fileName, double interval = 60.0);
+	~Checkpoint();   // finishes the write in progress
+
+	/* Reads fileName into saved(). Returns false if there is no such file;
+	 * throws std::runtime_error if it is not a checkpoint file. */
+	bool load();
+	bool loaded() const { return haveSaved; }
+	const CheckpointState& saved() const { return savedState; }
+
+	/* The sink of the run (0: none), kept in step with the checkpoints:
+	 * flushed before every save, and resumed at the loaded checkpoint by
+	 * begin(). Set by the checkpoint overloads of simulate and
+	 * simulateAdaptive (see FollowedSink). */
+	void follow(TrajectorySink* sink) { trajectory = sink; }
+
+	/* Called by the step loop before its first step. Checks a loaded
+	 * checkpoint against the run (std::invalid_argument if it was written
+	 * by another one) and returns true if the run resumes from it. */
+	bool begin(IntegrationMethod method, int nDim, double t0, double t1, long long nStep);
+
+	/* Called by the step loop after each accepted step: true when a
+	 * checkpoint should be taken (interval seconds after the last one,
+	 * as told by the writer thread). */
+	bool due() const { return timeUp.load(std::memory_order_relaxed); }
+
+	/* Takes a checkpoint of the loop at time t: copies the state z[], the
+	 * next step size, the workspace's FSAL stage (if the next step would
+	 * reuse it) and the step counters, and hands them to the writer.
+	 * wait() returns once the checkpoint is on disk. */
+	void save(double t, const double z[], double dt, StepperWorkspace& work,
+	          long long nAccept, long long nReject, long long nEval);
+	void wait();
+
+	/* Checkpoints written so far */
+	long long nWritten() const { return written.load(); }
+
+private:
+	Checkpoint(const Checkpoint&);
+	Checkpoint& operator=(const Checkpoint&);
+
+	void arm();
+	void writerLoop();
+	void writeFile(const CheckpointState& state);
+	void throwPendingError();
+
+	std::string fileName;
+	double interval;
+	TrajectorySink* trajectory;     // not owned
+	std::atomic<bool> timeUp;       // a checkpoint is due
+	bool armed;                     // nextDue is set
+	std::chrono::steady_clock::time_point nextDue;
+
+	bool haveSaved;
+	CheckpointState savedState;
+
+	CheckpointState front;          // filled by the step loop
+	CheckpointState back;           // being written
+	std::atomic<bool> busy;         // back holds a state not yet on disk
+	std::atomic<long long> written;
+	bool stopping;
+	std::string error;              // last write failure, until thrown
+
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::condition_variable done;
+	std::thread writer;
+};
+
+/* Has a checkpoint follow a sink for as long as it lives */
+class FollowedSink {
+public:
+	FollowedSink(Checkpoint& checkpoint, TrajectorySink& sink) : checkpoint(checkpoint) {
+		checkpoint.follow(&sink);
+	}
+	~FollowedSink() { checkpoint.follow(0); }
+
+private:
+	Checkpoint& checkpoint;
+};
+
+/* Puts a checkpoint's state back: z[] and the workspace's FSAL stage */
+void restoreStepperState(const CheckpointState& state, double z[], StepperWorkspace& work);
+
+#endif
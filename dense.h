@@ -0,0 +1,233 @@
+#ifndef __DENSE_H__
+#define __DENSE_H__
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "sink.h"
+#include "stepper.h"
+#include "RK_45.h"
+#include "RK_5.h"
+#include "RK_10.h"
+#include "RK_DP5.h"
+
+/* Dense output: the solution at any time inside a step that was just taken,
+ * built from the stage derivatives the step left in the workspace.
+ *
+ * RK_45, RK_5 and RK_DP5 use their 4th-order continuous extensions (the D
+ * tables of their tableaus). The methods of order 4 and below use cubic
+ * Hermite interpolation between (zLow, f(tLow, zLow)) and (zUpp, f(tUpp,
+ * zUpp)), which is as accurate as the steps themselves. Both need
+ * f(tUpp, zUpp): RK_DP5 has it as its last stage, the others make one
+ * extra evaluation, only for steps that contain an output time. The
+ * symplectic, implicit and low-storage methods keep no f(tLow, zLow)
+ * either, and make a second.
+ *
+ * RK_10 has no continuous extension, and no cheap interpolant comes close
+ * to its accuracy. Its steps get a Hermite interpolant of degree 9 through
+ * zLow, zUpp and three RK_10 sub-steps from tLow, to a quarter, half and
+ * three quarters of the step, matching the derivative at all five points:
+ * 3 * 17 + 4 = 55 evaluations, built once for the step whatever the number
+ * of output points in it. emit() takes the sub-steps straight to the
+ * output times instead when a step holds at most RK10_DIRECT_MAX of them,
+ * which is cheaper (17 each) and exact.
+ */
+
+/* Output points per step up to which emit() steps RK_10 to each one */
+const int RK10_DIRECT_MAX = 3;
+
+class DenseOutput {
+public:
+	DenseOutput(int nDim, IntegrationMethod method) :
+		nDim(nDim), method(method), ownLow(isSymplectic(method) || isImplicit(method) || isLowStorage(method)),
+		fLow(ownLow || method == RK_10 ? nDim : 0), fUpp(nDim), zOut(nDim),
+		zMid(method == RK_10 ? 3 * nDim : 0), fMid(method == RK_10 ? 3 * nDim : 0),
+		coef(method == RK_10 ? 10 * nDim : 0), haveUpp(false), nEvalTotal(0) {}
+
+	/* Call once after each step, before the first at() or emit() for it */
+	void startStep() { haveUpp = false; }
+
+	/* Solution at time t inside the step from (tLow, zLow) to (tUpp, zUpp),
+	 * taken with the given workspace. The result stays valid until the next
+	 * call. */
+	template <class Dyn>
+	const double* at(Dyn& dynFun, double t, double tLow, double tUpp,
+	                 double zLow[], double zUpp[], StepperWorkspace& work)
+	{
+		double dt = tUpp - tLow;
+		if (method == RK_10) {
+			if (!haveUpp) {
+				buildRK10(dynFun, tLow, tUpp, zLow, zUpp, work);
+				haveUpp = true;
+			}
+			hermite10((t - tLow) / dt);
+			return zOut.data();
+		}
+		if (!haveUpp && method != RK_DP5) {
+			dynFun(tUpp, zUpp, fUpp.data());
+			nEvalTotal++;
+			if (ownLow) {
+				dynFun(tLow, zLow, fLow.data());
+				nEvalTotal++;
+			}
+			haveUpp = true;
+		}
+		interpolate((t - tLow) / dt, dt, zLow, zUpp, work);
+		return zOut.data();
+	}
+
+	/* Passes the solution at every tOut[iOut] up to tUpp (all that are left,
+	 * if lastStep) to the sink, advancing iOut. Starts a new step. */
+	template <class Dyn>
+	void emit(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[],
+	          StepperWorkspace& work, const std::vector<double>& tOut, size_t& iOut,
+	          bool lastStep, TrajectorySink& sink)
+	{
+		startStep();
+		size_t iEnd = iOut;
+		while (iEnd < tOut.size() && (lastStep || tOut[iEnd] <= tUpp)) {
+			iEnd++;
+		}
+		bool direct = method == RK_10 && iEnd - iOut <= (size_t) RK10_DIRECT_MAX;
+		for (; iOut < iEnd; iOut++) {
+			const double *z;
+			if (direct) {
+				/// The step is done with, so its workspace is free for this one:
+				rk10step(dynFun, tLow, tOut[iOut], zLow, zOut.data(), nDim, work);
+				nEvalTotal += RK10__Tableau::nStage;
+				z = zOut.data();
+			} else {
+				z = at(dynFun, tOut[iOut], tLow, tUpp, zLow, zUpp, work);
+			}
+			sink.record(tOut[iOut], z, nDim);
+		}
+	}
+
+	/* Dynamics evaluations made so far by at() and emit() */
+	int nEval() const { return nEvalTotal; }
+
+private:
+	template <class Tableau>
+	void extension(double theta, double dt, const double zLow[], StepperWorkspace& work) {
+		const int nTerm = Tableau::nDense;
+		double w[nTerm];
+		const double *f[nTerm];
+		for (int i = 0; i < nTerm; i++) {
+			const double *d = &Tableau::D[4 * i];
+			w[i] = theta * (d[0] + theta * (d[1] + theta * (d[2] + theta * d[3])));
+			f[i] = i < Tableau::nStage ? work.f(i) : fUpp.data();
+		}
+		if (nDim >= SIMD_MIN_DIM) {
+			combineStages(work, zOut.data(), zLow, dt, w, f, nTerm, nDim);
+		} else {
+			for (int iDim = 0; iDim < nDim; iDim++) {
+				double sum = 0.0;
+				for (int i = 0; i < nTerm; i++) {
+					sum = sum + w[i] * f[i][iDim];
+				}
+				zOut[iDim] = zLow[iDim] + dt * sum;
+			}
+		}
+	}
+
+	void hermite(double theta, double dt, const double zLow[], const double zUpp[],
+	             StepperWorkspace& work) {
+		double s = theta;
+		double h00 = (1.0 + 2.0 * s) * (1.0 - s) * (1.0 - s);
+		double h10 = s * (1.0 - s) * (1.0 - s);
+		double h01 = s * s * (3.0 - 2.0 * s);
+		double h11 = s * s * (s - 1.0);
+		const double *f0 = ownLow ? fLow.data() : work.f(0);
+		for (int iDim = 0; iDim < nDim; iDim++) {
+			zOut[iDim] = h00 * zLow[iDim] + h01 * zUpp[iDim]
+			           + dt * (h10 * f0[iDim] + h11 * fUpp[iDim]);
+		}
+	}
+
+	/* The RK_10 interpolant of the step: the Newton form of the Hermite
+	 * polynomial in theta = (t - tLow) / dt, from divided differences over
+	 * the nodes 0, 1/4, 1/2, 3/4, 1, each taken twice. coef[k * nDim + i]
+	 * is coefficient k of component i. */
+	template <class Dyn>
+	void buildRK10(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[],
+	               StepperWorkspace& work) {
+		double dt = tUpp - tLow;
+		std::copy(work.f(0), work.f(0) + nDim, fLow.data());   // f(tLow, zLow), before the sub-steps
+		for (int k = 0; k < 3; k++) {
+			double t = tLow + 0.25 * (k + 1) * dt;
+			rk10step(dynFun, tLow, t, zLow, &zMid[k * nDim], nDim, work);
+			dynFun(t, &zMid[k * nDim], &fMid[k * nDim]);
+		}
+		dynFun(tUpp, zUpp, fUpp.data());
+		nEvalTotal += 3 * RK10__Tableau::nStage + 4;
+
+		const double node[5] = {0.0, 0.25, 0.5, 0.75, 1.0};
+		const double *z[5] = {zLow, &zMid[0], &zMid[nDim], &zMid[2 * nDim], zUpp};
+		const double *f[5] = {fLow.data(), &fMid[0], &fMid[nDim], &fMid[2 * nDim], fUpp.data()};
+		for (int iDim = 0; iDim < nDim; iDim++) {
+			double q[10];
+			for (int k = 9; k >= 0; k--) {
+				q[k] = z[k / 2][iDim];
+			}
+			for (int j = 1; j < 10; j++) {
+				for (int k = 9; k >= j; k--) {
+					double width = node[k / 2] - node[(k - j) / 2];
+					q[k] = width == 0.0 ? dt * f[k / 2][iDim]   // a repeated node: dz/dtheta
+					                    : (q[k] - q[k - 1]) / width;
+				}
+			}
+			for (int k = 0; k < 10; k++) {
+				coef[k * nDim + iDim] = q[k];
+			}
+		}
+	}
+
+	void hermite10(double theta) {
+		const double node[5] = {0.0, 0.25, 0.5, 0.75, 1.0};
+		for (int iDim = 0; iDim < nDim; iDim++) {
+			double sum = coef[9 * nDim + iDim];
+			for (int k = 8; k >= 0; k--) {
+				sum = coef[k * nDim + iDim] + (theta - node[k / 2]) * sum;
+			}
+			zOut[iDim] = sum;
+		}
+	}
+
+	void interpolate(double theta, double dt, const double zLow[], const double zUpp[],
+	                 StepperWorkspace& work) {
+		switch (method) {
+		case RK_45:
+			extension<RK45__Tableau>(theta, dt, zLow, work); break;
+		case RK_5:
+			extension<RK5__Tableau>(theta, dt, zLow, work); break;
+		case RK_DP5:
+			extension<DP5__Tableau>(theta, dt, zLow, work); break;
+		default:
+			hermite(theta, dt, zLow, zUpp, work); break;
+		}
+	}
+
+	int nDim;
+	IntegrationMethod method;
+	bool ownLow;                // work.f(0) is not f(tLow, zLow)
+	std::vector<double> fLow;   // f(tLow, zLow), for those methods and RK_10
+	std::vector<double> fUpp;   // f(tUpp, zUpp)
+	std::vector<double> zOut;
+	std::vector<double> zMid;   // RK_10: the states at the interior nodes,
+	std::vector<double> fMid;   // their derivatives,
+	std::vector<double> coef;   // and the interpolant
+	bool haveUpp;     // fUpp is up to date for this step
+	int nEvalTotal;
+};
+
+/* Checks an output grid for the dense simulate overloads */
+inline void checkOutputTimes(const std::vector<double>& tOut, double t0, double t1) {
+	for (size_t i = 0; i < tOut.size(); i++) {
+		if (tOut[i] < t0 || tOut[i] > t1 || (i > 0 && tOut[i] < tOut[i-1])) {
+			throw std::invalid_argument("output times must be ascending and within [t0, t1]");
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef __EVENTS_H__
+#define __EVENTS_H__
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <vector>
+
+#include "dense.h"
+#include "profile.h"
+
+/* Event detection: a guard function g(t, z) is checked after every step, and
+ * a sign change inside the step is an event. Its time is found on the
+ * step's interpolant (see DenseOutput), so locating it costs no dynamics
+ * evaluations beyond those that build the interpolant (one or two, 55 for
+ * RK_10), once per step with a crossing. */
+
+/* What the integration does once an event has happened */
+enum EventAction {
+	EventContinue,    // record it and carry on
+	EventTerminate    // stop the run at the event
+};
+
+struct Event {
+	std::function<double(double t, const double z[])> guard;
+	EventAction action;
+	int direction;    // +1: only g rising through zero, -1: only falling, 0: both
+
+	Event(std::function<double(double, const double[])> guard,
+	      EventAction action = EventContinue, int direction = 0) :
+		guard(guard), action(action), direction(direction) {}
+};
+
+/* One event that happened */
+struct EventHit {
+	int iEvent;               // index into the list of events
+	double t;
+	std::vector<double> z;    // state at t
+};
+
+/* What the event overloads of simulate / simulateAdaptive report */
+struct EventResult {
+	std::vector<EventHit> hits;   // in time order
+	bool terminated;              // stopped by an EventTerminate event
+	double tEnd;                  // time the run ended (t1 if not terminated)
+	RunSummary summary;           // instrumentation (see profile.h)
+
+	EventResult() : terminated(false), tEnd(0.0) {}
+};
+
+/* Watches the guards step by step and locates their zero crossings */
+class EventLocator {
+public:
+	EventLocator(const std::vector<Event>& events, int nDim, IntegrationMethod method) :
+		events(events), nDim(nDim), dense(nDim, method), gLow(events.size()), gUpp(events.size()) {}
+
+	/* Guard values at the start of the run */
+	void start(double t0, const double z0[]) {
+		for (size_t i = 0; i < events.size(); i++) {
+			gLow[i] = events[i].guard(t0, z0);
+		}
+	}
+
+	/* Call after every step from (tLow, zLow) to (tUpp, zUpp). Appends the
+	 * events inside the step to hits. If one of them terminates the run,
+	 * moves (tUpp, zUpp) back to it and returns false. */
+	template <class Dyn>
+	bool check(Dyn& dynFun, double tLow, double& tUpp, double zLow[], double zUpp[],
+	           StepperWorkspace& work, std::vector<EventHit>& hits)
+	{
+		dense.startStep();
+
+		/// Locate every crossing in the step:
+		std::vector<EventHit> found;
+		for (size_t i = 0; i < events.size(); i++) {
+			gUpp[i] = events[i].guard(tUpp, zUpp);
+			if (!crosses(events[i].direction, gLow[i], gUpp[i])) {
+				continue;
+			}
+			EventHit hit;
+			hit.iEvent = (int) i;
+			hit.t = locate(dynFun, events[i], tLow, tUpp, gLow[i], gUpp[i], zLow, zUpp, work);
+			const double *z = hit.t == tUpp ? zUpp : dense.at(dynFun, hit.t, tLow, tUpp, zLow, zUpp, work);
+			hit.z.assign(z, z + nDim);
+			found.push_back(hit);
+		}
+		std::stable_sort(found.begin(), found.end(),
+		                 [](const EventHit& a, const EventHit& b) { return a.t < b.t; });
+
+		/// Keep everything up to the first terminating event:
+		for (size_t k = 0; k < found.size(); k++) {
+			hits.push_back(found[k]);
+			if (events[found[k].iEvent].action == EventTerminate) {
+				tUpp = found[k].t;
+				std::copy(found[k].z.begin(), found[k].z.end(), zUpp);
+				return false;
+			}
+		}
+		gLow.swap(gUpp);
+		return true;
+	}
+
+	/* Dynamics evaluations made while locating events */
+	int nEval() const { return dense.nEval(); }
+
+private:
+	static bool crosses(int direction, double g0, double g1) {
+		bool rising = g0 < 0.0 && g1 >= 0.0;
+		bool falling = g0 > 0.0 && g1 <= 0.0;
+		return (direction >= 0 && rising) || (direction <= 0 && falling);
+	}
+
+	/* Zero of the guard on the interpolant, by the Illinois variant of
+	 * regula falsi: superlinear, and always inside the bracket. */
+	template <class Dyn>
+	double locate(Dyn& dynFun, const Event& event, double tLow, double tUpp,
+	              double gA, double gB, double zLow[], double zUpp[], StepperWorkspace& work)
+	{
+		const double eps = std::numeric_limits<double>::epsilon();
+		double a = tLow, b = tUpp;
+		int side = 0;
+		for (int iter = 0; iter < 100; iter++) {
+			if (b - a <= 4.0 * eps * std::max(std::fabs(a), std::fabs(b))) {
+				break;
+			}
+			double t = (a * gB - b * gA) / (gB - gA);
+			if (!(t > a && t < b)) {
+				t = 0.5 * (a + b);
+			}
+			double g = event.guard(t, dense.at(dynFun, t, tLow, tUpp, zLow, zUpp, work));
+			if (g == 0.0) {
+				return t;
+			}
+			if ((g < 0.0) == (gB < 0.0)) {
+				b = t; gB = g;
+				if (side == -1) { gA *= 0.5; }
+				side = -1;
+			} else {
+				a = t; gA = g;
+				if (side == +1) { gB *= 0.5; }
+				side = +1;
+			}
+		}
+		return b;   // the end of the bracket on which the sign has changed
+	}
+
+	const std::vector<Event>& events;
+	int nDim;
+	DenseOutput dense;
+	std::vector<double> gLow;   // guard values at the start of the step
+	std::vector<double> gUpp;   // ... and at its end
+};
+
+#endif
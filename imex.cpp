@@ -0,0 +1,6 @@
+#include "imex.h"
+
+template void ark4Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                               StepperWorkspace&);
+template void ark4Step<ImexDynFun>(ImexDynFun&, double, double, double[], double[], int,
+                                    StepperWorkspace&);
@@ -0,0 +1,372 @@
+#ifndef __IMEX_H__
+#define __IMEX_H__
+
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+#include "implicit.h"
+#include "profile.h"
+#include "stepper.h"
+#include "tableau.h"
+
+/* Implicit-explicit (IMEX) additive Runge-Kutta methods, for dynamics that
+ * split into a stiff part that is cheap to solve for (diffusion, damping)
+ * and a non-stiff part that is expensive or strongly nonlinear:
+ *     dz/dt = fE(t, z) + fI(t, z)
+ *
+ * Every stage takes fE explicitly, with an explicit tableau in the format
+ * of tableau.h, and fI implicitly, with a singly diagonally implicit
+ * tableau on the same nodes whose first stage is explicit (ESDIRK). Only fI
+ * goes into the Newton iterations (see implicit.h). Their matrix
+ * I - h*gamma*J, with J the Jacobian of fI, is the same for every stage,
+ * so it is factored once and reused, step after step, for as long as dt
+ * and J stay as they are. For a linear fI each stage costs one solve.
+ *
+ * The split is declared with imexDynamics:
+ *
+ *     auto dyn = imexDynamics(nonStiffFun, stiffFun, nDim, ImplicitOptions());
+ *     simulate(dyn, t0, t1, z0, z1, nDim, nStep, ARK_4);
+ *
+ * or with a Jacobian of the stiff part, jacobian(t, z, J) as for
+ * stiffDynamics. The result is also an ordinary dynamics function,
+ * fE + fI, so every other method, dense output and events work with it.
+ * Given unsplit dynamics, ARK_4 treats all of them implicitly: its ESDIRK
+ * tableau alone is an L-stable method of order 4. */
+
+/* Dynamics split into a non-stiff part, taken explicitly, and a stiff
+ * part, taken implicitly */
+template <class Explicit, class Implicit, class Jac = NoJacobian>
+struct ImexDynamics {
+	Explicit nonStiff;                    // fE
+	StiffDynamics<Implicit, Jac> stiff;   // fI, with its Jacobian and options
+	std::vector<double> scratch;          // nDim
+
+	/* dz = fE + fI */
+	void operator()(double t, double z[], double dz[]) {
+		nonStiff(t, z, dz);
+		stiff(t, z, scratch.data());
+		for (size_t i = 0; i < scratch.size(); i++) {
+			dz[i] += scratch[i];
+		}
+	}
+};
+
+template <class Explicit, class Implicit>
+ImexDynamics<Explicit, Implicit> imexDynamics(Explicit nonStiffFun, Implicit stiffFun, int nDim,
+                                                const ImplicitOptions& options) {
+	return ImexDynamics<Explicit, Implicit>{nonStiffFun, stiffDynamics(stiffFun, options),
+	                                         std::vector<double>(nDim)};
+}
+
+template <class Explicit, class Implicit, class Jac>
+ImexDynamics<Explicit, Implicit, Jac> imexDynamics(Explicit nonStiffFun, Implicit stiffFun,
+                                                     Jac jacobian, int nDim,
+                                                     const ImplicitOptions& options) {
+	return ImexDynamics<Explicit, Implicit, Jac>{nonStiffFun,
+	                                              stiffDynamics(stiffFun, jacobian, options),
+	                                              std::vector<double>(nDim)};
+}
+
+/* Both parts as plain function pointers */
+typedef ImexDynamics<DynFun, DynFun> ImexDynFun;
+
+/* True for ImexDynamics, also behind std::ref and the profiler */
+template <class Dyn>
+struct IsImexDynamics : std::false_type {};
+
+template <class Explicit, class Implicit, class Jac>
+struct IsImexDynamics<ImexDynamics<Explicit, Implicit, Jac> > : std::true_type {};
+
+template <class Dyn>
+struct IsImexDynamics<std::reference_wrapper<Dyn> > : IsImexDynamics<Dyn> {};
+
+template <class Dyn>
+struct IsImexDynamics<ProfiledDynamics<Dyn> > : IsImexDynamics<Dyn> {};
+
+template <class Dyn>
+struct IsImexDynamics<CountedDynamics<Dyn> > : IsImexDynamics<Dyn> {};
+
+/* The part of the dynamics taken implicitly: the stiff part, or all of
+ * unsplit dynamics. Bind the result with auto&&. */
+template <class Dyn>
+inline Dyn& stiffPart(Dyn& dynFun) {
+	return dynFun;
+}
+
+template <class Explicit, class Implicit, class Jac>
+inline StiffDynamics<Implicit, Jac>& stiffPart(ImexDynamics<Explicit, Implicit, Jac>& dynFun) {
+	return dynFun.stiff;
+}
+
+template <class Dyn>
+inline auto& stiffPart(std::reference_wrapper<Dyn>& dynFun) {
+	return stiffPart(dynFun.get());
+}
+
+template <class Dyn>
+inline auto stiffPart(ProfiledDynamics<Dyn>& dynFun) {
+	auto& part = stiffPart(dynFun.dynFun);
+	return ProfiledDynamics<std::remove_reference_t<decltype(part)> >{part, dynFun.profiler};
+}
+
+template <class Dyn>
+inline auto stiffPart(CountedDynamics<Dyn>& dynFun) {
+	auto& part = stiffPart(dynFun.dynFun);
+	return CountedDynamics<std::remove_reference_t<decltype(part)> >{part, dynFun.nEval};
+}
+
+/* The part taken explicitly, of ImexDynamics */
+template <class Explicit, class Implicit, class Jac>
+inline Explicit& nonStiffPart(ImexDynamics<Explicit, Implicit, Jac>& dynFun) {
+	return dynFun.nonStiff;
+}
+
+template <class Dyn>
+inline auto& nonStiffPart(std::reference_wrapper<Dyn>& dynFun) {
+	return nonStiffPart(dynFun.get());
+}
+
+template <class Dyn>
+inline auto nonStiffPart(ProfiledDynamics<Dyn>& dynFun) {
+	auto& part = nonStiffPart(dynFun.dynFun);
+	return ProfiledDynamics<std::remove_reference_t<decltype(part)> >{part, dynFun.profiler};
+}
+
+template <class Dyn>
+inline auto nonStiffPart(CountedDynamics<Dyn>& dynFun) {
+	auto& part = nonStiffPart(dynFun.dynFun);
+	return CountedDynamics<std::remove_reference_t<decltype(part)> >{part, dynFun.nEval};
+}
+
+
+/******************************************************************************
+ *                           ARK4(3)6L[2]SA                                   *
+ ******************************************************************************/
+
+/* Kennedy and Carpenter's ARK4(3)6L[2]SA: 6 stages, order 4 (the embedded
+ * order-3 weights are not used). The explicit tableau, in the format of
+ * tableau.h. */
+struct ARK4E__Tableau {
+	static constexpr int nStage = 6;
+
+	static constexpr double A[] = {
+		0.0, 1.0 / 2.0, 83.0 / 250.0, 31.0 / 50.0, 17.0 / 20.0, 1.0
+	};
+
+	static constexpr double B[] = {
+		1.0 / 2.0,
+		13861.0 / 62500.0,	6889.0 / 62500.0,
+		-116923316275.0 / 2393684061468.0,	-2731218467317.0 / 15368042101831.0,
+			9408046702089.0 / 11113171139209.0,
+		-451086348788.0 / 2902428689909.0,	-2682348792572.0 / 7519795681897.0,
+			12662868775082.0 / 11960479115383.0,	3355817975965.0 / 11060851509271.0,
+		647845179188.0 / 3216320057751.0,	73281519250.0 / 8382639484533.0,
+			552539513391.0 / 3454668386233.0,	3354512671639.0 / 8306763924573.0,
+			4040.0 / 17871.0
+	};
+
+	static constexpr double C[] = {
+		82889.0 / 524892.0, 0.0, 15625.0 / 83664.0, 69875.0 / 102672.0, -2260.0 / 8211.0, 1.0 / 4.0
+	};
+};
+
+/* The implicit tableau: B is the strict lower triangle, and every stage
+ * but the first adds gamma on the diagonal. L-stable and stiffly accurate
+ * (its last row is C). */
+struct ARK4I__Tableau {
+	static constexpr double gamma = 1.0 / 4.0;
+	static constexpr int nStage = 6;
+
+	static constexpr double A[] = {
+		0.0, 1.0 / 2.0, 83.0 / 250.0, 31.0 / 50.0, 17.0 / 20.0, 1.0
+	};
+
+	static constexpr double B[] = {
+		1.0 / 4.0,
+		8611.0 / 62500.0,	-1743.0 / 31250.0,
+		5012029.0 / 34652500.0,	-654441.0 / 2922500.0,	174375.0 / 388108.0,
+		15267082809.0 / 155376265600.0,	-71443401.0 / 120774400.0,	730878875.0 / 902184768.0,
+			2285395.0 / 8070912.0,
+		82889.0 / 524892.0,	0.0,	15625.0 / 83664.0,	69875.0 / 102672.0,	-2260.0 / 8211.0
+	};
+
+	static constexpr double C[] = {
+		82889.0 / 524892.0, 0.0, 15625.0 / 83664.0, 69875.0 / 102672.0, -2260.0 / 8211.0, 1.0 / 4.0
+	};
+};
+
+/* True if the two tableaus of an additive method take their stages at the
+ * same times */
+template <class Explicit, class Implicit>
+constexpr bool sameNodes() {
+	for (int i = 0; i < Explicit::nStage; i++) {
+		if (Explicit::A[i] != Implicit::A[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+/******************************************************************************
+ *                        Additive Runge-Kutta Step                           *
+ ******************************************************************************/
+
+/* Computes stage iStage and every stage after it: the explicit sums of
+ * both tableaus (as in fixedStages), then the Newton solve for the stage.
+ * fE is only used for split dynamics. Returns false if a solve fails. */
+template <class Explicit, class Implicit, int iStage, bool split, class NonStiff, class Stiff>
+inline bool arkStages(NonStiff& nonStiff, Stiff& stiff, ImplicitSolver& solver, double tLow,
+                      double dt, double zLow[], int nDim, StepperWorkspace& work,
+                      double* const fE[], double* const fI[])
+{
+	if constexpr (iStage < Explicit::nStage) {
+		const int row = iStage * (iStage - 1) / 2;
+		double hg = dt * Implicit::gamma;
+		double *base = solver.base.data();
+		double *zi = work.z(iStage);
+		double *fi = fI[iStage];
+
+		/// base = zLow + dt * sum_{j<i} (BE_ij fE_j + BI_ij fI_j):
+		if (nDim >= SIMD_MIN_DIM) {
+			combineStages(work, base, zLow, dt, Implicit::B + row, fI, iStage, nDim);
+			if constexpr (split) {
+				combineStages(work, base, base, dt, Explicit::B + row, fE, iStage, nDim);
+			}
+		} else {
+			for (int iDim = 0; iDim < nDim; iDim++) {
+				double sum = fixedWeightedSum<Implicit, TableauB, row, 0, iStage>(-0.0, fI, iDim);
+				if constexpr (split) {
+					sum = sum + fixedWeightedSum<Explicit, TableauB, row, 0, iStage>(-0.0, fE, iDim);
+				}
+				base[iDim] = zLow[iDim] + dt * sum;
+			}
+		}
+
+		/// Solve zi = base + hg fI(ti, zi), from the guess base + hg fI_{i-1}:
+		double ti = tLow + Implicit::A[iStage] * dt;
+		for (int iDim = 0; iDim < nDim; iDim++) {
+			zi[iDim] = base[iDim] + hg * fI[iStage - 1][iDim];
+		}
+		if (!newtonStage(stiff, solver, ti, hg, base, zi)) {
+			return false;
+		}
+		for (int iDim = 0; iDim < nDim; iDim++) {
+			fi[iDim] = (zi[iDim] - base[iDim]) / hg;
+		}
+		if constexpr (split) {
+			nonStiff(ti, zi, fE[iStage]);
+		}
+		return arkStages<Explicit, Implicit, iStage + 1, split>(nonStiff, stiff, solver, tLow, dt,
+		                                                        zLow, nDim, work, fE, fI);
+	} else {
+		return true;
+	}
+}
+
+/* One try at an additive Runge-Kutta step (see implicitStep), with
+ * nonStiff taken explicitly if split is true. The workspace holds the
+ * explicit stage derivatives in f(0 ... nStage-1) and the implicit ones in
+ * f(nStage ... 2*nStage-1). Arguments match RK_STEP. */
+template <class Explicit, class Implicit, bool split, class NonStiff, class Stiff>
+bool ARK_ATTEMPT(NonStiff& nonStiff, Stiff& stiff, ImplicitSolver& solver, double tLow, double tUpp,
+                 double zLow[], double zUpp[], int nDim, StepperWorkspace& work)
+{
+	const int nStage = Explicit::nStage;
+	static_assert(Implicit::nStage == nStage, "the tableaus need the same number of stages");
+	static_assert(std::size(Explicit::A) == nStage && std::size(Implicit::A) == nStage,
+	              "A[] needs nStage entries");
+	static_assert(std::size(Explicit::B) == nStage * (nStage - 1) / 2
+	              && std::size(Implicit::B) == nStage * (nStage - 1) / 2,
+	              "B[] needs the nStage*(nStage-1)/2 entries of the strict lower triangle");
+	static_assert(std::size(Explicit::C) == nStage && std::size(Implicit::C) == nStage,
+	              "C[] needs nStage entries");
+	static_assert(sameNodes<Explicit, Implicit>(), "the tableaus need the same nodes A[]");
+	static_assert(Implicit::A[0] == 0.0, "the first implicit stage must be explicit");
+
+	double dt = tUpp - tLow;
+	if (!solver.factorStage(dt * Implicit::gamma)) {
+		return false;
+	}
+	double *fE[nStage];
+	double *fI[nStage];
+	for (int iStage = 0; iStage < nStage; iStage++) {
+		fE[iStage] = work.f(iStage);
+		fI[iStage] = work.f(nStage + iStage);
+	}
+
+	/// The first stage is explicit in both parts:
+	stiff(tLow, zLow, fI[0]);
+	if constexpr (split) {
+		nonStiff(tLow, zLow, fE[0]);
+	}
+	if (!arkStages<Explicit, Implicit, 1, split>(nonStiff, stiff, solver, tLow, dt, zLow, nDim,
+	                                             work, fE, fI)) {
+		return false;
+	}
+
+	/// Compute the final estimate:
+	if (nDim >= SIMD_MIN_DIM) {
+		combineStages(work, zUpp, zLow, dt, Implicit::C, fI, nStage, nDim);
+		if constexpr (split) {
+			combineStages(work, zUpp, zUpp, dt, Explicit::C, fE, nStage, nDim);
+		}
+		return true;
+	}
+	for (int iDim = 0; iDim < nDim; iDim++) {
+		double sum = fixedWeightedSum<Implicit, TableauC, 0, 0, nStage>(-0.0, fI, iDim);
+		if constexpr (split) {
+			sum = sum + fixedWeightedSum<Explicit, TableauC, 0, 0, nStage>(-0.0, fE, iDim);
+		}
+		zUpp[iDim] = zLow[iDim] + dt * sum;
+	}
+	return true;
+}
+
+/* Additive Runge-Kutta step for a pair of tableaus as above. Split
+ * dynamics take their non-stiff part explicitly; any other dynamics are
+ * taken implicitly as a whole. Arguments match RK_STEP. */
+template <class Explicit, class Implicit, class Dyn>
+void ARK_STEP(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+              StepperWorkspace& work)
+{
+	work.clearLastStage();
+	auto&& stiff = stiffPart(dynFun);
+	ImplicitSolver& solver = implicitSolver(stiff, work);
+	if constexpr (IsImexDynamics<Dyn>::value) {
+		auto&& nonStiff = nonStiffPart(dynFun);
+		implicitStep(stiff, solver, tLow, tUpp, zLow, zUpp,
+			[&](double t0, double t1, double z0[], double z1[]) {
+				return ARK_ATTEMPT<Explicit, Implicit, true>(nonStiff, stiff, solver, t0, t1,
+				                                             z0, z1, nDim, work);
+			});
+	} else {
+		implicitStep(stiff, solver, tLow, tUpp, zLow, zUpp,
+			[&](double t0, double t1, double z0[], double z1[]) {
+				return ARK_ATTEMPT<Explicit, Implicit, false>(stiff, stiff, solver, t0, t1,
+				                                              z0, z1, nDim, work);
+			});
+	}
+}
+
+
+/******************************************************************************
+ *                           Step Functions                                   *
+ ******************************************************************************/
+
+template <class Dyn>
+void ark4Step(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+              StepperWorkspace& work) {
+	ARK_STEP<ARK4E__Tableau, ARK4I__Tableau>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work);
+}
+
+/* Compiled once, in imex.cpp, for plain function pointers (unsplit and
+ * split) */
+extern template void ark4Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                      StepperWorkspace&);
+extern template void ark4Step<ImexDynFun>(ImexDynFun&, double, double, double[], double[], int,
+                                           StepperWorkspace&);
+
+#endif
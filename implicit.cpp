@@ -0,0 +1,322 @@
+#include "implicit.h"
+
+
+/******************************************************************************
+ *                             Newton Matrix                                  *
+ ******************************************************************************/
+
+void NewtonMatrix::resize(int size, int lower, int upper) {
+	n = size;
+	if (lower >= 0 && upper >= 0) {
+		kl = lower;
+		ku = upper;
+		ld = 2 * kl + ku + 1;
+		a.assign((size_t) ld * n, 0.0);
+	} else {
+		kl = ku = -1;
+		ld = 0;
+		a.assign((size_t) n * n, 0.0);
+	}
+	pivot.assign(n, 0);
+}
+
+void NewtonMatrix::setShifted(const NewtonMatrix& J, double h) {
+	resize(J.n, J.kl, J.ku);
+	for (int j = 0; j < n; j++) {
+		int iLow = banded() ? std::max(0, j - ku) : 0;
+		int iUpp = banded() ? std::min(n - 1, j + kl) : n - 1;
+		for (int i = iLow; i <= iUpp; i++) {
+			(*this)(i, j) = (i == j ? 1.0 : 0.0) - h * J(i, j);
+		}
+	}
+}
+
+void NewtonMatrix::setKronecker(const NewtonMatrix& J, double h, const double A[], int nStage) {
+	int s = nStage;
+	if (J.banded()) {
+		resize(s * J.n, s * J.kl + s - 1, s * J.ku + s - 1);
+	} else {
+		resize(s * J.n, -1, -1);
+	}
+	for (int j = 0; j < J.n; j++) {
+		int iLow = J.banded() ? std::max(0, j - J.ku) : 0;
+		int iUpp = J.banded() ? std::min(J.n - 1, j + J.kl) : J.n - 1;
+		for (int i = iLow; i <= iUpp; i++) {
+			double Jij = J(i, j);
+			for (int k = 0; k < s; k++) {
+				for (int r = 0; r < s; r++) {
+					(*this)(s * i + k, s * j + r) = (i == j && k == r ? 1.0 : 0.0) - h * A[s * k + r] * Jij;
+				}
+			}
+		}
+	}
+}
+
+bool NewtonMatrix::factor() {
+	if (!banded()) {
+		for (int k = 0; k < n; k++) {
+			/// Pivot: the largest entry of column k on or below the diagonal
+			int p = k;
+			for (int i = k + 1; i < n; i++) {
+				if (std::fabs((*this)(i, k)) > std::fabs((*this)(p, k))) {
+					p = i;
+				}
+			}
+			pivot[k] = p;
+			if ((*this)(p, k) == 0.0) {
+				return false;
+			}
+			if (p != k) {
+				std::swap_ranges(&a[(size_t) k * n], &a[(size_t) k * n] + n, &a[(size_t) p * n]);
+			}
+			double inv = 1.0 / (*this)(k, k);
+			for (int i = k + 1; i < n; i++) {
+				double l = (*this)(i, k) *= inv;
+				if (l != 0.0) {
+					double *rowI = &a[(size_t) i * n];
+					const double *rowK = &a[(size_t) k * n];
+					for (int j = k + 1; j < n; j++) {
+						rowI[j] -= l * rowK[j];
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	/// Banded (the unblocked algorithm of LAPACK's dgbtf2). Entry (r, c)
+	/// of the band storage is ab[r + c * ld]; the diagonal is row kv.
+	double *ab = a.data();
+	const int kv = kl + ku;
+	for (int j = ku + 1; j < std::min(kv, n); j++) {
+		for (int r = kv - j; r < kl; r++) {
+			ab[r + (size_t) j * ld] = 0.0;
+		}
+	}
+	int ju = 0;   // last column touched by the row interchanges so far
+	for (int j = 0; j < n; j++) {
+		if (j + kv < n) {
+			for (int r = 0; r < kl; r++) {
+				ab[r + (size_t) (j + kv) * ld] = 0.0;   // fill-in of column j + kv
+			}
+		}
+		int km = std::min(kl, n - 1 - j);   // subdiagonal entries of column j
+		double *col = ab + kv + (size_t) j * ld;
+		int jp = 0;
+		for (int p = 1; p <= km; p++) {
+			if (std::fabs(col[p]) > std::fabs(col[jp])) {
+				jp = p;
+			}
+		}
+		pivot[j] = j + jp;
+		if (col[jp] == 0.0) {
+			return false;
+		}
+		ju = std::max(ju, std::min(j + ku + jp, n - 1));
+		if (jp != 0) {
+			for (int c = 0; c <= ju - j; c++) {
+				std::swap(ab[kv + jp - c + (size_t) (j + c) * ld], ab[kv - c + (size_t) (j + c) * ld]);
+			}
+		}
+		if (km > 0) {
+			double inv = 1.0 / col[0];
+			for (int p = 1; p <= km; p++) {
+				col[p] *= inv;
+			}
+			for (int c = 1; c <= ju - j; c++) {
+				double *colC = ab + (size_t) (j + c) * ld;
+				double y = colC[kv - c];   // row j of column j + c
+				if (y != 0.0) {
+					for (int r = 1; r <= km; r++) {
+						colC[kv + r - c] -= col[r] * y;
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
+
+void NewtonMatrix::solve(double b[]) const {
+	if (!banded()) {
+		for (int k = 0; k < n; k++) {
+			if (pivot[k] != k) {
+				std::swap(b[k], b[pivot[k]]);
+			}
+		}
+		for (int i = 1; i < n; i++) {
+			const double *row = &a[(size_t) i * n];
+			double sum = b[i];
+			for (int k = 0; k < i; k++) {
+				sum -= row[k] * b[k];
+			}
+			b[i] = sum;
+		}
+		for (int i = n - 1; i >= 0; i--) {
+			const double *row = &a[(size_t) i * n];
+			double sum = b[i];
+			for (int k = i + 1; k < n; k++) {
+				sum -= row[k] * b[k];
+			}
+			b[i] = sum / row[i];
+		}
+		return;
+	}
+
+	/// Banded (LAPACK's dgbtrs):
+	const double *ab = a.data();
+	const int kv = kl + ku;
+	for (int j = 0; j < n - 1; j++) {
+		int lm = std::min(kl, n - 1 - j);
+		int l = pivot[j];
+		if (l != j) {
+			std::swap(b[l], b[j]);
+		}
+		const double *col = ab + kv + (size_t) j * ld;
+		for (int p = 1; p <= lm; p++) {
+			b[j + p] -= col[p] * b[j];
+		}
+	}
+	for (int j = n - 1; j >= 0; j--) {
+		const double *col = ab + (size_t) j * ld;
+		if (b[j] != 0.0) {
+			b[j] /= col[kv];
+			double t = b[j];
+			for (int i = std::max(0, j - kv); i < j; i++) {
+				b[i] -= t * col[kv + i - j];
+			}
+		}
+	}
+}
+
+
+/******************************************************************************
+ *                            Implicit Solver                                 *
+ ******************************************************************************/
+
+ImplicitSolver::ImplicitSolver(int nDim, const ImplicitOptions& options) :
+	nDim(nDim), options(options), jacFresh(false), jacStale(true), stageH(0.0), kronH(0.0),
+	scale(nDim), base(3 * nDim), dx(3 * nDim), fz(nDim), zp(nDim),
+	hist(BDF_MAX_ORDER, std::vector<double>(nDim)), nHist(0), tHist(0.0), hHist(0.0),
+	nJacobian(0), nFactor(0), nFailure(0)
+{
+	int lower = options.lower, upper = options.upper;
+	if (options.sparsity) {
+		if (options.sparsity->size() != nDim) {
+			throw std::invalid_argument("ImplicitSolver: sparsity pattern does not match nDim");
+		}
+		pattern = *options.sparsity;
+		lower = std::max(lower, pattern.lower());   // the band must hold the pattern
+		upper = std::max(upper, pattern.upper());
+	}
+
+	/// Banded storage only pays off when the band is narrower than the matrix:
+	if (lower < 0 || upper < 0 || 2 * lower + upper + 1 >= nDim) {
+		lower = upper = -1;
+	}
+	jac.resize(nDim, lower, upper);
+
+	/// Finite differences by colors, if the nonzeros are known:
+	if (!options.sparsity && jac.banded()) {
+		pattern = SparsityPattern::banded(nDim, lower, upper);
+	}
+	if (options.sparsity || jac.banded()) {
+		coloring = colorColumns(pattern);
+	}
+}
+
+/* The factors are kept while the step size changes by less than this */
+static const double REFACTOR_TOL = 1e-3;
+
+bool ImplicitSolver::factorStage(double hg) {
+	if (stageH != 0.0 && std::fabs(hg - stageH) <= REFACTOR_TOL * std::fabs(stageH)) {
+		return true;
+	}
+	stage.setShifted(jac, hg);
+	nFactor++;
+	stageH = stage.factor() ? hg : 0.0;
+	return stageH != 0.0;
+}
+
+bool ImplicitSolver::factorKronecker(double h, const double A[], int nStage) {
+	if (kronH != 0.0 && std::fabs(h - kronH) <= REFACTOR_TOL * std::fabs(kronH)) {
+		return true;
+	}
+	kron.setKronecker(jac, h, A, nStage);
+	nFactor++;
+	kronH = kron.factor() ? h : 0.0;
+	return kronH != 0.0;
+}
+
+void ImplicitSolver::setScale(const double z[]) {
+	double relTol = std::max(options.relTol, NEWTON_REL_TOL_MIN);
+	for (int i = 0; i < nDim; i++) {
+		scale[i] = options.absTol + relTol * std::fabs(z[i]);
+	}
+}
+
+double ImplicitSolver::norm(const double dx[], int size) const {
+	int perDim = size / nDim;
+	double sum = 0.0;
+	for (int i = 0; i < size; i++) {
+		double e = dx[i] / scale[i / perDim];
+		sum += e * e;
+	}
+	return std::sqrt(sum / size);
+}
+
+int ImplicitSolver::judge(int iter, double dxNorm, double& dxNormOld) {
+	/// Converged once the error left after this update (estimated from the
+	/// contraction rate theta) is below the tolerances:
+	int status = 0;
+	if (iter == 0) {
+		status = dxNorm <= 1.0 ? 1 : 0;
+	} else {
+		double theta = dxNorm / dxNormOld;
+		if (theta >= 1.0) {
+			return -1;
+		}
+		if (theta > 0.5) {
+			jacStale = true;   // slow: worth a new Jacobian next step
+		}
+		status = theta / (1.0 - theta) * dxNorm <= 1.0 ? 1 : 0;
+	}
+	dxNormOld = dxNorm;
+	if (status == 0 && iter + 1 >= options.maxNewton) {
+		jacStale = true;
+		return -1;
+	}
+	return status;
+}
+
+void pushHistory(ImplicitSolver& solver, double t, double h, const double z[]) {
+	std::rotate(solver.hist.begin(), solver.hist.end() - 1, solver.hist.end());
+	std::copy(z, z + solver.nDim, solver.hist[0].begin());
+	solver.nHist = std::min(solver.nHist + 1, BDF_MAX_ORDER);
+	solver.tHist = t;
+	solver.hHist = h;
+}
+
+bool historyMatches(const ImplicitSolver& solver, double t, double dt, const double z[], int nPast) {
+	if (solver.nHist < nPast || solver.tHist != t) {
+		return false;
+	}
+	if (solver.nHist > 1 && std::fabs(dt - solver.hHist) > 1e-10 * std::fabs(dt)) {
+		return false;
+	}
+	return std::equal(z, z + solver.nDim, solver.hist[0].begin());
+}
+
+
+/******************************************************************************
+ *                  Function-Pointer Instantiations                           *
+ ******************************************************************************/
+
+template void sdirk3Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                 StepperWorkspace&);
+template void radau5Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                 StepperWorkspace&);
+template void bdf2Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                               StepperWorkspace&);
+template void bdf5Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                               StepperWorkspace&);
@@ -0,0 +1,660 @@
+#ifndef __IMPLICIT_H__
+#define __IMPLICIT_H__
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "profile.h"
+#include "sparsity.h"
+#include "stepper.h"
+
+/* Implicit methods, for stiff systems: SDIRK_3, RADAU_5 and BDF_2 / BDF_5.
+ *
+ * Each step solves its stage equations by simplified Newton iterations
+ * with the matrix I - h*gamma*J (RADAU_5: I - h*A(x)J, for all three
+ * stages at once). The Jacobian J comes from the user (see StiffDynamics)
+ * or from finite differences, and it and the LU factors of the Newton
+ * matrix are cached in the workspace: J is only re-evaluated when the
+ * Newton iterations start to converge slowly or fail, and the LU factors
+ * only when J or the step size changes. A step whose iterations fail even
+ * with a fresh Jacobian is split in two.
+ *
+ * The matrices are banded when the Jacobian's bandwidths are declared (or
+ * follow from its sparsity pattern) and the band is narrower than the
+ * matrix, dense otherwise: banded and dense LU are the only factorizations
+ * here, there is no general sparse one. A pattern whose band fills the
+ * matrix (periodic boundaries, arrow shapes) is thus solved densely, in
+ * O(nDim^3) per factorization; renumbering the unknowns (e.g. reverse
+ * Cuthill-McKee) narrows the band when the coupling allows it. With either,
+ * finite differences go by colors (see sparsity.h) and cost a few
+ * evaluations instead of nDim.
+ *
+ * These are fixed-step methods (no error estimate); every other driver
+ * works with them as with the explicit ones. */
+
+/* The smallest relative error the Newton iterations aim for (16 units of
+ * round-off); closer than that, round-off stalls them */
+const double NEWTON_REL_TOL_MIN = 16.0 * std::numeric_limits<double>::epsilon();
+
+/* Settings for the implicit methods.
+ *
+ * The methods are fixed-step, so the Newton tolerances cannot follow a
+ * step error estimate: every step keeps an error of up to relTol, and
+ * nStep steps up to nStep * relTol, however accurate the method. Below
+ * that floor, refining dt makes the result worse. The defaults are
+ * therefore at round-off (relTol below NEWTON_REL_TOL_MIN counts as
+ * NEWTON_REL_TOL_MIN), which puts the floor at most at nStep * 4e-15
+ * relative, and in practice lower (2e-14 after 640 RADAU_5 steps of a
+ * smooth problem). Larger tolerances save a Newton iteration or two per
+ * solve, at the price of a floor of about nStep * relTol. */
+struct ImplicitOptions {
+	int lower;       // Jacobian bandwidths: J(i, j) = 0 for i - j > lower or
+	int upper;       // j - i > upper  (< 0: not known, dense storage)
+	double relTol;   // the Newton iterations stop once the remaining error
+	double absTol;   // is below absTol + relTol * |z[i]|
+	int maxNewton;   // iterations per solve before it counts as failed
+	const SparsityPattern *sparsity;   // where J can be nonzero (0: not known); not owned,
+	                                   // copied when the solver is created
+
+	ImplicitOptions() :
+		lower(-1), upper(-1), relTol(NEWTON_REL_TOL_MIN), absTol(1e-16), maxNewton(10),
+		sparsity(0) {}
+};
+
+/* Square matrix for the Newton iterations: dense (row-major) or banded
+ * (LAPACK band storage, with room for the fill-in of pivoting). Factored
+ * in place by LU decomposition with partial pivoting. */
+class NewtonMatrix {
+public:
+	NewtonMatrix() : n(0), kl(-1), ku(-1), ld(0) {}
+
+	/* n x n, with bandwidths lower and upper (lower < 0: dense). Zeroes it. */
+	void resize(int size, int lower, int upper);
+
+	int size() const { return n; }
+	bool banded() const { return kl >= 0; }
+	int lower() const { return kl; }
+	int upper() const { return ku; }
+	bool inBand(int i, int j) const { return kl < 0 || (i - j <= kl && j - i <= ku); }
+
+	/* Element (i, j). For a banded matrix, only those inBand exist. */
+	double& operator()(int i, int j) { return kl < 0 ? a[(size_t) i * n + j] : a[(kl + ku + i - j) + (size_t) j * ld]; }
+	double operator()(int i, int j) const { return kl < 0 ? a[(size_t) i * n + j] : a[(kl + ku + i - j) + (size_t) j * ld]; }
+
+	void setZero() { std::fill(a.begin(), a.end(), 0.0); }
+
+	/* this = I - h * J, with the shape of J */
+	void setShifted(const NewtonMatrix& J, double h);
+
+	/* this = I - h * (A kron J): the Newton matrix of an s-stage fully
+	 * implicit method, with the stages of each component next to each other
+	 * (row s*i + k is stage k of component i), so a band stays a band. */
+	void setKronecker(const NewtonMatrix& J, double h, const double A[], int nStage);
+
+	/* LU decomposition in place; false if the matrix is singular */
+	bool factor();
+
+	/* Solves A x = b in place, after factor() */
+	void solve(double b[]) const;
+
+private:
+	int n;
+	int kl;
+	int ku;
+	int ld;                    // banded: rows of the band storage
+	std::vector<double> a;
+	std::vector<int> pivot;
+};
+
+/* Dynamics with what the implicit methods can use: a Jacobian (or
+ * NoJacobian, for finite differences) and ImplicitOptions. Also callable as
+ * an ordinary dynamics function, so it works with every method. */
+struct NoJacobian {};
+
+template <class Dyn, class Jac = NoJacobian>
+struct StiffDynamics {
+	Dyn dynFun;
+	Jac jacobian;               // jacobian(t, z, J): J(i, j) = d dz[i] / d z[j], into a zeroed NewtonMatrix
+	ImplicitOptions options;
+
+	void operator()(double t, double z[], double dz[]) { dynFun(t, z, dz); }
+};
+
+template <class Dyn>
+StiffDynamics<Dyn> stiffDynamics(Dyn dynFun, const ImplicitOptions& options) {
+	return StiffDynamics<Dyn>{dynFun, NoJacobian(), options};
+}
+
+template <class Dyn, class Jac>
+StiffDynamics<Dyn, Jac> stiffDynamics(Dyn dynFun, Jac jacobian, const ImplicitOptions& options) {
+	return StiffDynamics<Dyn, Jac>{dynFun, jacobian, options};
+}
+
+/* The options of any dynamics: ImplicitOptions() unless it is StiffDynamics */
+template <class Dyn>
+inline ImplicitOptions implicitOptions(Dyn&) {
+	return ImplicitOptions();
+}
+
+template <class Dyn, class Jac>
+inline ImplicitOptions implicitOptions(StiffDynamics<Dyn, Jac>& dynFun) {
+	return dynFun.options;
+}
+
+template <class Dyn>
+inline ImplicitOptions implicitOptions(std::reference_wrapper<Dyn>& dynFun) {
+	return implicitOptions(dynFun.get());
+}
+
+template <class Dyn>
+inline ImplicitOptions implicitOptions(ProfiledDynamics<Dyn>& dynFun) {
+	return implicitOptions(dynFun.dynFun);
+}
+
+template <class Dyn>
+inline ImplicitOptions implicitOptions(CountedDynamics<Dyn>& dynFun) {
+	return implicitOptions(dynFun.dynFun);
+}
+
+/* Fills J from the user's Jacobian, if the dynamics have one */
+template <class Dyn>
+inline bool userJacobian(Dyn&, double, double[], NewtonMatrix&) {
+	return false;
+}
+
+template <class Dyn, class Jac>
+inline bool userJacobian(StiffDynamics<Dyn, Jac>& dynFun, double t, double z[], NewtonMatrix& J) {
+	if constexpr (std::is_same<Jac, NoJacobian>::value) {
+		return false;
+	} else {
+		dynFun.jacobian(t, z, J);
+		return true;
+	}
+}
+
+template <class Dyn>
+inline bool userJacobian(std::reference_wrapper<Dyn>& dynFun, double t, double z[], NewtonMatrix& J) {
+	return userJacobian(dynFun.get(), t, z, J);
+}
+
+template <class Dyn>
+inline bool userJacobian(ProfiledDynamics<Dyn>& dynFun, double t, double z[], NewtonMatrix& J) {
+	return userJacobian(dynFun.dynFun, t, z, J);
+}
+
+template <class Dyn>
+inline bool userJacobian(CountedDynamics<Dyn>& dynFun, double t, double z[], NewtonMatrix& J) {
+	return userJacobian(dynFun.dynFun, t, z, J);
+}
+
+/* Jacobian, Newton matrices and history of the implicit methods. Lives in
+ * the StepperWorkspace (see implicitSolver), so it persists across steps. */
+class ImplicitSolver {
+public:
+	ImplicitSolver(int nDim, const ImplicitOptions& options);
+
+	/* Factors I - hg * J, unless that is already done for (nearly) this hg */
+	bool factorStage(double hg);
+
+	/* Factors I - h * (A kron J) for the RADAU_5 stages, likewise */
+	bool factorKronecker(double h, const double A[], int nStage);
+
+	/* Error weights for the Newton updates, from the state z */
+	void setScale(const double z[]);
+
+	/* Weighted RMS norm of an update of the n (or n * nStage) unknowns */
+	double norm(const double dx[], int size) const;
+
+	/* Sorts a Newton iteration: call with the norm of every update.
+	 * Returns +1 once converged, -1 if it diverges or runs out of
+	 * iterations, 0 to go on. Marks J stale when convergence is slow. */
+	int judge(int iter, double dxNorm, double& dxNormOld);
+
+	int nDim;
+	ImplicitOptions options;
+	NewtonMatrix jac;
+	SparsityPattern pattern;     // of J, when it is sparse or banded
+	ColumnColoring coloring;     // of its columns (nColor() == 0: dense J)
+	bool jacFresh;        // J was evaluated during the current step
+	bool jacStale;        // re-evaluate J before the next step
+	NewtonMatrix stage;   // LU of I - hg J
+	double stageH;        // hg it was factored for (0: none)
+	NewtonMatrix kron;    // LU of I - h (A kron J)
+	double kronH;
+	std::vector<double> scale, base, dx, fz, zp;
+
+	/* BDF history: hist[0] is the latest state, hist[1] the one before... */
+	std::vector<std::vector<double> > hist;
+	int nHist;
+	double tHist;         // time of hist[0]
+	double hHist;         // step between the history states
+
+	/* Counters over the life of the solver */
+	long long nJacobian;
+	long long nFactor;
+	long long nFailure;   // steps that had to be split
+};
+
+/* The solver of a workspace, created on first use with the options of the
+ * dynamics */
+template <class Dyn>
+ImplicitSolver& implicitSolver(Dyn& dynFun, StepperWorkspace& work) {
+	ImplicitSolver *solver = work.implicitSolver();
+	if (!solver || solver->nDim != work.nDim()) {
+		solver = new ImplicitSolver(work.nDim(), implicitOptions(dynFun));
+		work.setImplicitSolver(solver);
+	}
+	return *solver;
+}
+
+/* J = df/dz at (t, z) by forward differences: by colors when the solver
+ * has a sparsity pattern, otherwise one column at a time */
+template <class Dyn>
+void finiteDifferenceJacobian(Dyn& dynFun, ImplicitSolver& solver, double t, double z[]) {
+	NewtonMatrix& J = solver.jac;
+	double *f0 = solver.fz.data(), *f1 = solver.dx.data(), *zp = solver.zp.data();
+	if (solver.coloring.nColor() > 0) {
+		coloredDifferences(dynFun, t, z, solver.pattern, solver.coloring, f0, f1, zp,
+			[&](int, int i, int j, double value) { J(i, j) = value; });
+		return;
+	}
+	const double eps = std::numeric_limits<double>::epsilon();
+	int n = J.size();
+	dynFun(t, z, f0);
+	std::copy(z, z + n, zp);
+	for (int j = 0; j < n; j++) {
+		zp[j] = z[j] + std::sqrt(eps * std::max(1e-5, std::fabs(z[j])));
+		dynFun(t, zp, f1);
+		double d = zp[j] - z[j];
+		for (int i = 0; i < n; i++) {
+			J(i, j) = (f1[i] - f0[i]) / d;
+		}
+		zp[j] = z[j];
+	}
+}
+
+/* Re-evaluates the cached Jacobian at (t, z) */
+template <class Dyn>
+void updateJacobian(Dyn& dynFun, ImplicitSolver& solver, double t, double z[]) {
+	solver.jac.setZero();
+	if (!userJacobian(dynFun, t, z, solver.jac)) {
+		finiteDifferenceJacobian(dynFun, solver, t, z);
+	}
+	solver.nJacobian++;
+	solver.jacFresh = true;
+	solver.jacStale = false;
+	solver.stageH = 0.0;
+	solver.kronH = 0.0;
+}
+
+/* Solves Z = base + hg * f(t, Z) for Z (holding the initial guess) with
+ * the factored stage matrix. Returns false if the iterations fail. */
+template <class Dyn>
+bool newtonStage(Dyn& dynFun, ImplicitSolver& solver, double t, double hg,
+                 const double base[], double Z[])
+{
+	int n = solver.nDim;
+	double *dx = solver.dx.data();
+	double *fz = solver.fz.data();
+	solver.setScale(Z);
+	double dxNormOld = 0.0;
+	for (int iter = 0; ; iter++) {
+		dynFun(t, Z, fz);
+		for (int i = 0; i < n; i++) {
+			dx[i] = base[i] + hg * fz[i] - Z[i];
+		}
+		solver.stage.solve(dx);
+		for (int i = 0; i < n; i++) {
+			Z[i] += dx[i];
+		}
+		int status = solver.judge(iter, solver.norm(dx, n), dxNormOld);
+		if (status != 0) {
+			return status > 0;
+		}
+	}
+}
+
+/* Runs attempt(tLow, tUpp, zLow, zUpp), a single try at the step that
+ * returns false if its Newton iterations fail. Brings the Jacobian up to
+ * date first if it is stale, retries once with a fresh one, and then
+ * splits the step in two. */
+template <class Dyn, class Attempt>
+void implicitStep(Dyn& dynFun, ImplicitSolver& solver, double tLow, double tUpp,
+                  double zLow[], double zUpp[], Attempt attempt, int depth = 0)
+{
+	solver.jacFresh = false;
+	if (solver.jacStale) {
+		updateJacobian(dynFun, solver, tLow, zLow);
+	}
+	if (attempt(tLow, tUpp, zLow, zUpp)) {
+		return;
+	}
+	if (!solver.jacFresh) {
+		updateJacobian(dynFun, solver, tLow, zLow);
+		if (attempt(tLow, tUpp, zLow, zUpp)) {
+			return;
+		}
+	}
+	solver.nFailure++;
+	if (depth >= 12) {
+		throw std::runtime_error("implicit step: the Newton iterations do not converge");
+	}
+	std::vector<double> zMid(solver.nDim);
+	double tMid = tLow + 0.5 * (tUpp - tLow);
+	implicitStep(dynFun, solver, tLow, tMid, zLow, zMid.data(), attempt, depth + 1);
+	implicitStep(dynFun, solver, tMid, tUpp, zMid.data(), zUpp, attempt, depth + 1);
+}
+
+
+/******************************************************************************
+ *                  Singly Diagonally Implicit Runge-Kutta                    *
+ ******************************************************************************/
+
+/* Like the explicit tableaus (see tableau.h), plus the diagonal gamma that
+ * every stage shares: stage i solves
+ *     z_i = zLow + dt * (sum_{j<i} B_ij f_j + gamma f(tLow + A_i dt, z_i))
+ *
+ * Alexander's 3-stage, L-stable SDIRK of order 3. gamma is the root of
+ * x^3 - 3x^2 + 3x/2 - 1/6 in (1/6, 1/2). Stiffly accurate: the solution
+ * is the last stage. */
+struct SDIRK3__Tableau {
+	static constexpr double gamma = 0.43586652150845899942;
+	static constexpr int nStage = 3;
+
+	static constexpr double A[] = {
+		gamma,
+		(1.0 + gamma) / 2.0,
+		1.0
+	};
+
+	static constexpr double C[] = {
+		-(6.0 * gamma * gamma - 16.0 * gamma + 1.0) / 4.0,
+		(6.0 * gamma * gamma - 20.0 * gamma + 5.0) / 4.0,
+		gamma
+	};
+
+	static constexpr double B[] = {
+		(1.0 - gamma) / 2.0,
+		-(6.0 * gamma * gamma - 16.0 * gamma + 1.0) / 4.0,	(6.0 * gamma * gamma - 20.0 * gamma + 5.0) / 4.0
+	};
+};
+
+/* One try at an SDIRK step (see implicitStep). Arguments match RK_STEP. */
+template <class Tableau, class Dyn>
+bool SDIRK_ATTEMPT(Dyn& dynFun, ImplicitSolver& solver, double tLow, double tUpp,
+                   double zLow[], double zUpp[], int nDim, StepperWorkspace& work)
+{
+	const int nStage = Tableau::nStage;
+	static_assert(std::size(Tableau::A) == nStage, "A[] needs nStage entries");
+	static_assert(std::size(Tableau::B) == nStage * (nStage - 1) / 2,
+	              "B[] needs the nStage*(nStage-1)/2 entries of the strict lower triangle");
+	static_assert(std::size(Tableau::C) == nStage, "C[] needs nStage entries");
+
+	double dt = tUpp - tLow;
+	double hg = dt * Tableau::gamma;
+	if (!solver.factorStage(hg)) {
+		return false;
+	}
+	double *base = solver.base.data();
+	for (int iStage = 0; iStage < nStage; iStage++) {
+		const double *b = &Tableau::B[iStage * (iStage - 1) / 2];
+		double *zi = work.z(iStage);
+		double *fi = work.f(iStage);
+		for (int i = 0; i < nDim; i++) {
+			double sum = 0.0;
+			for (int j = 0; j < iStage; j++) {
+				sum += b[j] * work.f(j)[i];
+			}
+			base[i] = zLow[i] + dt * sum;
+			zi[i] = iStage == 0 ? zLow[i] : base[i] + hg * work.f(iStage - 1)[i];
+		}
+		if (!newtonStage(dynFun, solver, tLow + Tableau::A[iStage] * dt, hg, base, zi)) {
+			return false;
+		}
+		/// The stage derivative, from the converged stage itself:
+		for (int i = 0; i < nDim; i++) {
+			fi[i] = (zi[i] - base[i]) / hg;
+		}
+	}
+	for (int i = 0; i < nDim; i++) {
+		double sum = 0.0;
+		for (int j = 0; j < nStage; j++) {
+			sum += Tableau::C[j] * work.f(j)[i];
+		}
+		zUpp[i] = zLow[i] + dt * sum;
+	}
+	return true;
+}
+
+/* SDIRK step for a tableau with a gamma, as above. Arguments match RK_STEP. */
+template <class Tableau, class Dyn>
+void SDIRK_STEP(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+                StepperWorkspace& work)
+{
+	work.clearLastStage();
+	ImplicitSolver& solver = implicitSolver(dynFun, work);
+	implicitStep(dynFun, solver, tLow, tUpp, zLow, zUpp,
+		[&](double t0, double t1, double z0[], double z1[]) {
+			return SDIRK_ATTEMPT<Tableau>(dynFun, solver, t0, t1, z0, z1, nDim, work);
+		});
+}
+
+
+/******************************************************************************
+ *                             Radau IIA                                      *
+ ******************************************************************************/
+
+/* The 3-stage Radau IIA method, order 5, L-stable and stiffly accurate.
+ * A[] holds the nodes, as in the other tableaus; the method is fully
+ * implicit, so M[] holds the whole (row-major) coefficient matrix in place
+ * of a lower triangle, and its last row is the weights. */
+struct Radau5__Tableau {
+	static constexpr int nStage = 3;
+	static constexpr double s6 = 2.4494897427831780982;   // sqrt(6)
+
+	static constexpr double A[] = {(4.0 - s6) / 10.0, (4.0 + s6) / 10.0, 1.0};
+
+	static constexpr double M[] = {
+		(88.0 - 7.0 * s6) / 360.0,		(296.0 - 169.0 * s6) / 1800.0,	(-2.0 + 3.0 * s6) / 225.0,
+		(296.0 + 169.0 * s6) / 1800.0,	(88.0 + 7.0 * s6) / 360.0,		(-2.0 - 3.0 * s6) / 225.0,
+		(16.0 - s6) / 36.0,				(16.0 + s6) / 36.0,				1.0 / 9.0
+	};
+};
+
+/* One try at a Radau IIA step (see implicitStep). The unknowns are the
+ * stage increments W_k = z_k - zLow, solved for all stages at once. */
+template <class Dyn>
+bool radau5Attempt(Dyn& dynFun, ImplicitSolver& solver, double tLow, double tUpp,
+                   double zLow[], double zUpp[], int nDim, StepperWorkspace& work)
+{
+	typedef Radau5__Tableau T;
+	const int s = T::nStage;
+	double dt = tUpp - tLow;
+	if (!solver.factorKronecker(dt, T::M, s)) {
+		return false;
+	}
+	double *w = solver.base.data();   // W, interleaved: w[s*i + k]
+	double *dx = solver.dx.data();
+	std::fill(w, w + s * nDim, 0.0);
+	solver.setScale(zLow);
+
+	double dxNormOld = 0.0;
+	for (int iter = 0; ; iter++) {
+		for (int k = 0; k < s; k++) {
+			double *zk = work.z(k);
+			for (int i = 0; i < nDim; i++) {
+				zk[i] = zLow[i] + w[s * i + k];
+			}
+			dynFun(tLow + T::A[k] * dt, zk, work.f(k));
+		}
+		for (int i = 0; i < nDim; i++) {
+			for (int k = 0; k < s; k++) {
+				double sum = 0.0;
+				for (int r = 0; r < s; r++) {
+					sum += T::M[s * k + r] * work.f(r)[i];
+				}
+				dx[s * i + k] = dt * sum - w[s * i + k];
+			}
+		}
+		solver.kron.solve(dx);
+		for (int i = 0; i < s * nDim; i++) {
+			w[i] += dx[i];
+		}
+		int status = solver.judge(iter, solver.norm(dx, s * nDim), dxNormOld);
+		if (status < 0) {
+			return false;
+		}
+		if (status > 0) {
+			break;
+		}
+	}
+	for (int i = 0; i < nDim; i++) {
+		zUpp[i] = zLow[i] + w[s * i + s - 1];
+	}
+	return true;
+}
+
+template <class Dyn>
+void radau5Step(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+                StepperWorkspace& work)
+{
+	work.clearLastStage();
+	ImplicitSolver& solver = implicitSolver(dynFun, work);
+	implicitStep(dynFun, solver, tLow, tUpp, zLow, zUpp,
+		[&](double t0, double t1, double z0[], double z1[]) {
+			return radau5Attempt(dynFun, solver, t0, t1, z0, z1, nDim, work);
+		});
+	solver.nHist = 0;
+}
+
+
+/******************************************************************************
+ *                    Backward Differentiation Formulas                       *
+ ******************************************************************************/
+
+/* Constant-step BDF of order k:
+ *     z_{n+1} = sum_{j=1..k} alpha_j z_{n+1-j} + beta dt f(t_{n+1}, z_{n+1})
+ * Row k-1 of BDF_ALPHA holds alpha_1 ... alpha_k. */
+const int BDF_MAX_ORDER = 5;
+const double BDF_ALPHA[BDF_MAX_ORDER][BDF_MAX_ORDER] = {
+	{1.0},
+	{4.0 / 3.0, -1.0 / 3.0},
+	{18.0 / 11.0, -9.0 / 11.0, 2.0 / 11.0},
+	{48.0 / 25.0, -36.0 / 25.0, 16.0 / 25.0, -3.0 / 25.0},
+	{300.0 / 137.0, -300.0 / 137.0, 200.0 / 137.0, -75.0 / 137.0, 12.0 / 137.0}
+};
+const double BDF_BETA[BDF_MAX_ORDER] = {1.0, 2.0 / 3.0, 6.0 / 11.0, 12.0 / 25.0, 60.0 / 137.0};
+
+/* Adds (t, z) to the BDF history, which must end at the previous step */
+void pushHistory(ImplicitSolver& solver, double t, double h, const double z[]);
+
+/* True if the history has nPast states that end at (t, z), dt apart (or
+ * holds just that one state) */
+bool historyMatches(const ImplicitSolver& solver, double t, double dt, const double z[], int nPast);
+
+/* A BDF step of order k. Multistep methods need the previous k - 1 states:
+ * as long as the steps follow each other with the same dt they come from
+ * the history; otherwise (at the start, or after dt changes) the step is
+ * taken by RADAU_5, whose order 5 keeps the start-up error below the BDF
+ * error. Arguments match RK_STEP. */
+template <int k, class Dyn>
+void bdfStep(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+             StepperWorkspace& work)
+{
+	static_assert(k >= 1 && k <= BDF_MAX_ORDER, "BDF order must be 1 ... 5");
+	work.clearLastStage();
+	ImplicitSolver& solver = implicitSolver(dynFun, work);
+	double dt = tUpp - tLow;
+
+	if (!historyMatches(solver, tLow, dt, zLow, k)) {
+		if (!historyMatches(solver, tLow, dt, zLow, 1)) {
+			solver.nHist = 0;
+			pushHistory(solver, tLow, dt, zLow);
+		}
+		implicitStep(dynFun, solver, tLow, tUpp, zLow, zUpp,
+			[&](double t0, double t1, double z0[], double z1[]) {
+				return radau5Attempt(dynFun, solver, t0, t1, z0, z1, nDim, work);
+			});
+		pushHistory(solver, tUpp, dt, zUpp);
+		return;
+	}
+
+	const double *alpha = BDF_ALPHA[k - 1];
+	double hb = BDF_BETA[k - 1] * dt;
+	bool converged = false;
+	solver.jacFresh = false;
+	if (solver.jacStale) {
+		updateJacobian(dynFun, solver, tLow, zLow);
+	}
+	for (;;) {
+		if (solver.factorStage(hb)) {
+			double *base = solver.base.data();
+			const double *z0 = solver.hist[0].data();
+			const double *z1 = solver.hist[1].data();
+			for (int i = 0; i < nDim; i++) {
+				double sum = 0.0;
+				for (int j = 0; j < k; j++) {
+					sum += alpha[j] * solver.hist[j][i];
+				}
+				base[i] = sum;
+				zUpp[i] = k > 1 ? 2.0 * z0[i] - z1[i] : z0[i];   // linear extrapolation
+			}
+			converged = newtonStage(dynFun, solver, tUpp, hb, base, zUpp);
+		}
+		if (converged || solver.jacFresh) {
+			break;
+		}
+		updateJacobian(dynFun, solver, tLow, zLow);
+	}
+	if (!converged) {
+		/// Restart from this state with the one-step method:
+		solver.nHist = 0;
+		pushHistory(solver, tLow, dt, zLow);
+		implicitStep(dynFun, solver, tLow, tUpp, zLow, zUpp,
+			[&](double t0, double t1, double z0[], double z1[]) {
+				return radau5Attempt(dynFun, solver, t0, t1, z0, z1, nDim, work);
+			});
+	}
+	pushHistory(solver, tUpp, dt, zUpp);
+}
+
+
+/******************************************************************************
+ *                           Step Functions                                   *
+ ******************************************************************************/
+
+template <class Dyn>
+void sdirk3Step(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+                StepperWorkspace& work) {
+	SDIRK_STEP<SDIRK3__Tableau>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work);
+}
+
+template <class Dyn>
+void bdf2Step(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+              StepperWorkspace& work) {
+	bdfStep<2>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work);
+}
+
+template <class Dyn>
+void bdf5Step(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+              StepperWorkspace& work) {
+	bdfStep<5>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work);
+}
+
+/* Compiled once, in implicit.cpp, for plain function pointers */
+extern template void sdirk3Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                        StepperWorkspace&);
+extern template void radau5Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                        StepperWorkspace&);
+extern template void bdf2Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                      StepperWorkspace&);
+extern template void bdf5Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                      StepperWorkspace&);
+
+#endif
@@ -2,288 +2,291 @@
 #include <fstream>
 using namespace std;
 
-#include <cmath>
-
 #include "integrator.h"
-#include "RK_2.h"
-#include "RK_4A.h"
-#include "RK_4B.h"
-#include "RK_45.h"
-#include "RK_5.h"
-#include "RK_10.h"
 
 
 /******************************************************************************
  *                           Utility Functions                                *
  ******************************************************************************/
 
-/* Prints the current time and state to the log file */
-void printState(std::ofstream& file, double t, double z[], int nDim) {
-	file << t ;
-	for (int j = 0; j < nDim; j++) {
-		file << ", " << z[j];
+/* Size of a cache line, in bytes. Each stage buffer starts on one. */
+static const int CACHE_LINE = 64;
+
+StepperWorkspace::StepperWorkspace(int nDim, int nStage) :
+	dim(nDim), stages(nStage), threads(0), lastTime(0.0), lastStage(-1), reused(false), solver(0)
+{
+	/// Pad each stage buffer to a whole number of cache lines:
+	const int perLine = CACHE_LINE / sizeof(double);
+	stride = ((nDim + perLine - 1) / perLine) * perLine;
+	int tLen = ((nStage + perLine - 1) / perLine) * perLine;
+
+	/// One block for everything, over-allocated so it can be aligned:
+	size_t nDouble = tLen + 2 * (size_t) nStage * stride;
+	block = new char[nDouble * sizeof(double) + CACHE_LINE];
+	size_t offset = (CACHE_LINE - ((size_t) block % CACHE_LINE)) % CACHE_LINE;
+	tBuf = (double*) (block + offset);
+	zBuf = tBuf + tLen;
+	fBuf = zBuf + (size_t) nStage * stride;
+
+	fPtr = new double*[nStage];
+	for (int i = 0; i < nStage; i++) {
+		fPtr[i] = f(i);
 	}
-	file << "\n";
 }
 
+StepperWorkspace::~StepperWorkspace() {
+	delete [] block;
+	delete [] fPtr;
+	delete solver;
+}
 
-/******************************************************************************
- *                     Hard-Coded Low-Order Methods                           *
- ******************************************************************************/
-
-/* Takes a simple euler step for the system */
-void eulerStep(DynFun dynFun, double t0, double t1, double z0[], double z1[], int nDim) {
-
-	double dt = t1 - t0;
-	double *dz;
-	dz = new double[nDim];
-
-	dynFun(t0, z0, dz);
-
-	for (int i = 0; i < nDim; i++) {
-		z1[i] = z0[i] + dt * dz[i];
+void StepperWorkspace::setImplicitSolver(ImplicitSolver* newSolver) {
+	if (newSolver != solver) {
+		delete solver;
+		solver = newSolver;
 	}
+}
 
-	delete [] dz;
+bool StepperWorkspace::reuseLastStage(double t, const double zLow[]) {
+	reused = false;
+	if (lastStage < 0 || t != lastTime) {
+		return false;
+	}
+	const double *zLast = z(lastStage);
+	for (int i = 0; i < dim; i++) {
+		if (zLow[i] != zLast[i]) {
+			return false;
+		}
+	}
+	std::copy(f(lastStage), f(lastStage) + dim, f(0));
+	reused = true;
+	return true;
+}
 
+/* Number of stages of each method: the size of its tableau, the kicks of a
+ * symplectic method, the RADAU_5 stages for the BDF methods (which start
+ * with it). Not a count of dynamics calls (see stepper.h). */
+int methodStageCount(IntegrationMethod method) {
+	switch (method) {
+	case Euler: return 1;
+	case MidPoint: return 2;
+	case RungeKutta: return 4;
+	case RK_2: return RK2__Tableau::nStage;
+	case RK_4A: return RK4A__Tableau::nStage;
+	case RK_4B: return RK4B__Tableau::nStage;
+	case RK_45: return RK45__Tableau::nStage;
+	case RK_5: return RK5__Tableau::nStage;
+	case RK_10: return RK10__Tableau::nStage;
+	case RK_DP5: return DP5__Tableau::nStage;
+	case StormerVerlet: return symplecticKickCount<SV__Tableau>();
+	case Yoshida4: return symplecticKickCount<Yoshida4__Tableau>();
+	case Yoshida6: return symplecticKickCount<Yoshida6__Tableau>();
+	case Yoshida8: return symplecticKickCount<Yoshida8__Tableau>();
+	case BlanesMoan: return symplecticKickCount<BM4__Tableau>();
+	case SDIRK_3: return SDIRK3__Tableau::nStage;
+	case RADAU_5: return Radau5__Tableau::nStage;
+	case BDF_2: return Radau5__Tableau::nStage;   // the start-up steps are RADAU_5
+	case BDF_5: return Radau5__Tableau::nStage;
+	case LSRK_3: return Williamson3__Tableau::nStage;
+	case LSRK_4: return CK4__Tableau::nStage;
+	case SSPRK_3: return SSP3__Tableau::nStage;
+	case SSPRK_4: return SSP104__Tableau::nStage;
+	case ARK_4: return ARK4E__Tableau::nStage;
+	}
+	return 0;
 }
 
+const char* methodName(IntegrationMethod method) {
+	switch (method) {
+	case Euler: return "Euler";
+	case MidPoint: return "MidPoint";
+	case RungeKutta: return "RungeKutta";
+	case RK_2: return "RK_2";
+	case RK_4A: return "RK_4A";
+	case RK_4B: return "RK_4B";
+	case RK_45: return "RK_45";
+	case RK_5: return "RK_5";
+	case RK_10: return "RK_10";
+	case RK_DP5: return "RK_DP5";
+	case StormerVerlet: return "StormerVerlet";
+	case Yoshida4: return "Yoshida4";
+	case Yoshida6: return "Yoshida6";
+	case Yoshida8: return "Yoshida8";
+	case BlanesMoan: return "BlanesMoan";
+	case SDIRK_3: return "SDIRK_3";
+	case RADAU_5: return "RADAU_5";
+	case BDF_2: return "BDF_2";
+	case BDF_5: return "BDF_5";
+	case LSRK_3: return "LSRK_3";
+	case LSRK_4: return "LSRK_4";
+	case SSPRK_3: return "SSPRK_3";
+	case SSPRK_4: return "SSPRK_4";
+	case ARK_4: return "ARK_4";
+	}
+	return "unknown";
+}
 
-/* Time step using the mid-point method */
-void midPointStep(DynFun dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim) {
+bool isSymplectic(IntegrationMethod method) {
+	return method == StormerVerlet || method == Yoshida4 || method == Yoshida6
+	       || method == Yoshida8 || method == BlanesMoan;
+}
 
-	double dt = tUpp - tLow;
+bool isImplicit(IntegrationMethod method) {
+	return method == SDIRK_3 || method == RADAU_5 || method == BDF_2 || method == BDF_5
+	       || method == ARK_4;
+}
 
-	/// Stage 0
-	double t0 = tLow;
-	double *z0 = zLow;
-	double *f0; f0 = new double[nDim];
-	dynFun(t0, z0, f0);
+bool isLowStorage(IntegrationMethod method) {
+	return method == LSRK_3 || method == LSRK_4 || method == SSPRK_3 || method == SSPRK_4;
+}
 
-	/// Stage 1
-	double t1 = t0 + 0.5 * dt;
-	double *z1; z1 = new double[nDim];
-	double *f1; f1 = new double[nDim];
-	for (int i = 0; i < nDim; i++) {
-		z1[i] = z0[i] + 0.5 * dt * f0[i];
-	}
-	dynFun(t1, z1, f1);
+bool stepsInPlace(IntegrationMethod method) {
+	return method == LSRK_3 || method == LSRK_4;
+}
 
-	/// Collect Stages:
-	for (int i = 0; i < nDim; i++) {
-		zUpp[i] = zLow[i] + dt * f1[i];
+int methodWorkspaceStages(IntegrationMethod method) {
+	if (method == ARK_4) {
+		return 2 * methodStageCount(method);   // explicit and implicit derivatives
 	}
-
-	delete [] f0;
-	delete [] f1;
-	delete [] z1;
-
+	return isLowStorage(method) ? 1 : methodStageCount(method);
 }
 
 
-/* Time step using 4th-order "Classical" Runge Kutta */
-void rungeKuttaStep(DynFun dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim) {
-
-	double dt = tUpp - tLow;
+/******************************************************************************
+ *                            Instrumentation                                 *
+ ******************************************************************************/
 
-	/// Stage 0
-	double t0 = tLow;
-	double *z0 = zLow;
-	double *f0; f0 = new double[nDim];
-	dynFun(t0, z0, f0);
+#ifdef RK_INSTRUMENT
 
-	/// Stage 1
-	double t1 = t0 + 0.5 * dt;
-	double *z1; z1 = new double[nDim];
-	double *f1; f1 = new double[nDim];
-	for (int i = 0; i < nDim; i++) {
-		z1[i] = zLow[i] + 0.5 * dt * f0[i];
+RunProfiler::RunProfiler() :
+	tickStart(profileTicks()), clockStart(std::chrono::steady_clock::now())
+{
+	for (int i = 0; i < nProfilePhase; i++) {
+		ticks[i] = 0;
 	}
-	dynFun(t1, z1, f1);
+}
 
-	/// Stage 2
-	double t2 = t1;
-	double *z2; z2 = new double[nDim];
-	double *f2; f2 = new double[nDim];
-	for (int i = 0; i < nDim; i++) {
-		z2[i] = zLow[i] + 0.5 * dt * f1[i];
-	}
-	dynFun(t2, z2, f2);
+RunSummary RunProfiler::finish() {
+	double seconds = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - clockStart).count();
+	unsigned long long elapsed = profileTicks() - tickStart;
+	double perTick = elapsed > 0 ? seconds / (double) elapsed : 0.0;
+
+	RunSummary result = summary;
+	result.timeDynamics = perTick * ticks[PhaseDynamics];
+	result.timeStages = perTick * ticks[PhaseStages];
+	result.timeAlloc = perTick * ticks[PhaseAlloc];
+	result.timeLogging = perTick * ticks[PhaseLogging];
+	result.timeTotal = seconds;
+	return result;
+}
 
-	/// Stage 3
-	double t3 = tLow + dt;
-	double *z3; z3 = new double[nDim];
-	double *f3; f3 = new double[nDim];
-	for (int i = 0; i < nDim; i++) {
-		z3[i] = zLow[i] + dt * f2[i];
-	}
-	dynFun(t3, z3, f3);
+#else
 
-	/// Collect Stages:
-	for (int i = 0; i < nDim; i++) {
-		zUpp[i] = zLow[i] + (dt / 6) * (f0[i] + 2.0 * f1[i] + 2.0 * f2[i] + f3[i]);
+RunProfiler::RunProfiler() : tickStart(0) {
+	for (int i = 0; i < nProfilePhase; i++) {
+		ticks[i] = 0;
 	}
+}
 
-	delete [] f0;
-	delete [] f1;
-	delete [] z1;
-	delete [] f2;
-	delete [] z2;
-	delete [] f3;
-	delete [] z3;
-
+RunSummary RunProfiler::finish() {
+	return RunSummary();
 }
 
+#endif
 
 
 /******************************************************************************
- *                      General-Form Runge-Kutta Step                         *
+ *                        Adaptive Step-Size Control                          *
  ******************************************************************************/
 
+bool hasErrorEstimate(IntegrationMethod method) {
+	return method == RK_45 || method == RK_10 || method == RK_DP5;
+}
 
-/* General-Purpose Runge--Kutta integration step, using a Butcher table.
- * tLow = time at beginning of the step
- * tUpp = time at the end of the step
- * zLow = state at the beginning of the step
- * zUpp = state at the end of the step (unknown  --  Computed by this function)
- * nDim = dimension of the state space
-  * A[] gives the time coefficients for the method
- * B[] gives the state propagation coefficients (assume lower triangular matrix)
- * C[] gives the solution coefficients for the method
- * nStage = number of stages in the Runge--Kutta method
- * Look at the example code to understand formatting for these inputs.
- */
-void RK_STEP(DynFun dynFun,
-             double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
-             double A[], double B[], double C[], int nStage)
+/* Scaled RMS norm of the error estimate. A value <= 1 meets the tolerances. */
+double errorNorm(double zLow[], double zUpp[], double zErr[], int nDim,
+                 const AdaptiveOptions& options)
 {
-
-	/// Allocate memory:
-	double t[nStage];
-	double** z = new double*[nStage];
-	for (int i = 0; i < nStage; i++) {
-		z[i] = new double[nDim];
-	}
-	double** f = new double*[nStage];
-	for (int i = 0; i < nStage; i++) {
-		f[i] = new double[nDim];
-	}
-
-	/// Populate time grid:
-	double dt = tUpp - tLow;
-	for (int iStage = 0; iStage < nStage; iStage++) {
-		t[iStage] = tLow + dt * A[iStage];
+	double sum = 0.0;
+	for (int i = 0; i < nDim; i++) {
+		double scale = options.absTol
+		               + options.relTol * std::max(std::fabs(zLow[i]), std::fabs(zUpp[i]));
+		double e = zErr[i] == 0.0 ? 0.0 : zErr[i] / scale;   // no 0/0 when absTol = 0
+		sum = sum + e * e;
 	}
+	return std::sqrt(sum / nDim);
+}
 
-	/// Initial State:
-	int iStage = 0;
-	for (int iDim = 0; iDim < nDim; iDim++) {
-		z[iStage][iDim] = zLow[iDim];
+StepSizeController::StepSizeController(const AdaptiveOptions& options, double dtMax) :
+	dtMin(options.dtMin), dtMax(dtMax), lastRejected(false)
+{
+	if (!(options.relTol > 0.0) && !(options.absTol > 0.0)) {
+		throw std::invalid_argument("StepSizeController: relTol or absTol must be positive");
 	}
+}
 
-	/// Dynamics at initial point:
-	dynFun(t[0], z[0], f[0]);
-
-	/// March through each stage:
-	double sum;
-	int idx;
-	for (int iStage = 1; iStage < nStage; iStage++) {
-		for (int iDim = 0; iDim < nDim; iDim++) {
-			sum = 0.0;
-			for (int j = 0; j < iStage; j++) {
-				idx = iStage*(iStage-1)/2 + j;   // Triangle numbers   
-				sum = sum + B[idx]*f[iStage - 1][iDim];
-			}
-			z[iStage][iDim] = zLow[iDim] + dt * sum;
+bool StepSizeController::judge(double err, int order, double& dt) {
+	/// Controller constants:
+	const double safety = 0.9;
+	const double minScale = 0.2;
+	const double maxScale = 5.0;
+
+	/// A NaN or infinite error estimate fails, whatever the step size:
+	if (!std::isfinite(err)) {
+		double dtNext = std::max(dtMin, dt * minScale);
+		if (!(dtNext > 0.0 && dtNext < dt)) {
+			throw std::runtime_error("StepSizeController: error estimate is not finite "
+			                         "at the smallest step size");
 		}
-		dynFun(t[iStage], z[iStage], f[iStage]);
+		lastRejected = true;
+		dt = dtNext;
+		return false;
 	}
 
-	/// Compute the final estimate:
-	for (int iDim = 0; iDim < nDim; iDim++) {
-		sum = 0.0;
-		for (int iStage = 0; iStage < nStage; iStage++) {
-			sum = sum + C[iStage] * f[iStage][iDim];
-		}
-		zUpp[iDim] = zLow[iDim] + dt * sum;
-	}
+	double scale = err > 0.0 ? safety * std::pow(err, -1.0 / (order + 1)) : maxScale;
+	scale = std::max(minScale, std::min(maxScale, scale));
 
-	/// Release memory:
-	for (int i = 0; i < nStage; i++) {
-		delete [] z[i];
+	bool accept = err <= 1.0 || dt <= dtMin;
+	if (accept && lastRejected) {
+		scale = std::min(scale, 1.0);   // don't grow right after a failure
 	}
-	delete [] z;
-	for (int i = 0; i < nStage; i++) {
-		delete [] f[i];
+	double dtNext = std::max(dtMin, std::min(dtMax, dt * scale));
+	if (!accept && !(dtNext > 0.0 && dtNext < dt)) {
+		throw std::runtime_error("StepSizeController: step size underflow");
 	}
-	delete [] f;
+	lastRejected = !accept;
+	dt = dtNext;
+	return accept;
 }
 
+
 /******************************************************************************
- *                      Simulation Wrapper Function                           *
+ *                  Function-Pointer Instantiations                           *
  ******************************************************************************/
 
-/* Runs several time steps using euler integration */
-void simulate(DynFun dynFun, double t0, double t1, double z0[], double z1[],
-              int nDim, int nStep, IntegrationMethod method)
-{
-	double dt, tLow, tUpp;
-	double *zLow;
-	double *zUpp;
-
-	/// Allocate memory:
-	zLow = new double[nDim];
-	zUpp = new double[nDim];
-
-	/// File IO stuff:
-	ofstream logFile;
-	logFile.open("logFile.csv");
-
-	/// Initial conditions
-	tLow = t0;
-	for (int i = 0; i < nDim; i++) {
-		zLow[i] = z0[i];
-	}
-
-	/// March forward in time:
-	dt = (t1 - t0) / ((double) nStep);
-	for (int i = 0; i < nStep; i++) {
-		tUpp = tLow + dt;
-		switch (method) {
-		case Euler:
-			eulerStep(dynFun, tLow, tUpp, zLow, zUpp, nDim); break;
-		case MidPoint:
-			midPointStep(dynFun, tLow, tUpp, zLow, zUpp, nDim); break;
-		case RungeKutta:
-			rungeKuttaStep(dynFun, tLow, tUpp, zLow, zUpp, nDim); break;
-		case RK_2:
-			rk2step(dynFun, tLow, tUpp, zLow, zUpp, nDim); break;
-		case RK_4A:
-			rk4Astep(dynFun, tLow, tUpp, zLow, zUpp, nDim); break;
-		case RK_4B:
-			rk4Bstep(dynFun, tLow, tUpp, zLow, zUpp, nDim); break;
-		case RK_45:
-			rk45step(dynFun, tLow, tUpp, zLow, zUpp, nDim); break;
-		case RK_5:
-			rk5step(dynFun, tLow, tUpp, zLow, zUpp, nDim); break;
-		case RK_10:
-			rk10step(dynFun, tLow, tUpp, zLow, zUpp, nDim); break;
-		}
-
-		/// Print the state of the simulation:
-		printState(logFile, tLow, zLow, nDim);
-
-		/// Advance temp variables:
-		tLow = tUpp;
-		for (int j = 0; j < nDim; j++) {
-			zLow[j] = zUpp[j];
-		}
-	}
-	printState(logFile, tLow, zLow, nDim);
-
-	delete [] zLow;
-	delete [] zUpp;
-
-	logFile.close();
-
-}
\ No newline at end of file
+template RunSummary simulate<DynFun>(DynFun, double, double, double[], double[],
+                                     int, int, IntegrationMethod);
+template RunSummary simulate<DynFun>(DynFun, double, double, double[], double[],
+                                     int, int, IntegrationMethod, TrajectorySink&);
+template RunSummary simulate<DynFun>(DynFun, double, double, double[], double[],
+                                     int, int, IntegrationMethod, TrajectorySink&, Checkpoint&);
+template AdaptiveStats simulateAdaptive<DynFun>(DynFun, double, double,
+                                                double[], double[], int,
+                                                IntegrationMethod,
+                                                const AdaptiveOptions&);
+template AdaptiveStats simulateAdaptive<DynFun>(DynFun, double, double,
+                                                double[], double[], int,
+                                                IntegrationMethod,
+                                                const AdaptiveOptions&,
+                                                TrajectorySink&);
+template AdaptiveStats simulateAdaptive<DynFun>(DynFun, double, double,
+                                                double[], double[], int,
+                                                IntegrationMethod,
+                                                const AdaptiveOptions&,
+                                                TrajectorySink&, Checkpoint&);
+template void simulateEnsemble<BatchDynFun>(BatchDynFun, double, double,
+                                            double[], double[], int, int, int,
+                                            IntegrationMethod);
+template void simulateParallel<DynFun>(DynFun, double, double, double[], double[],
+                                       int, int, IntegrationMethod, int);
@@ -1,26 +1,797 @@
 #ifndef __INTEGRATOR_H__
 #define __INTEGRATOR_H__
 
-typedef void (*DynFun)(double, double[], double[]);
-
-enum IntegrationMethod {
-	Euler,
-	MidPoint,
-	RungeKutta,
-	RK_2,
-	RK_4A,
-	RK_4B,
-	RK_45,
-	RK_5,
-	RK_10
+#include <fstream>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "checkpoint.h"
+#include "dense.h"
+#include "events.h"
+#include "profile.h"
+#include "sink.h"
+#include "stepper.h"
+#include "trajectory.h"
+#include "RK_2.h"
+#include "RK_4A.h"
+#include "RK_4B.h"
+#include "RK_45.h"
+#include "RK_5.h"
+#include "RK_10.h"
+#include "RK_DP5.h"
+#include "symplectic.h"
+#include "implicit.h"
+#include "lowstorage.h"
+#include "imex.h"
+#include "precision.h"
+
+/* Settings for the adaptive step-size controller. A step is accepted when
+ * the RMS of zErr[i] / (absTol + relTol * |z[i]|) is at most one. */
+struct AdaptiveOptions {
+	double relTol;
+	double absTol;
+	double dtInit;   // first trial step  (<= 0: use (t1 - t0) / 100)
+	double dtMin;    // steps this small are accepted regardless of error
+	double dtMax;    // largest allowed step  (<= 0: no limit)
+	bool recordErrors;   // keep the error norm of every accepted step
+
+	AdaptiveOptions() :
+		relTol(1e-6), absTol(1e-9), dtInit(0.0), dtMin(0.0), dtMax(0.0),
+		recordErrors(false) {}
+};
+
+/* Step counts reported by simulateAdaptive */
+struct AdaptiveStats {
+	int nAccept;    // accepted steps
+	int nReject;    // rejected (repeated) steps
+	int nEval;      // calls to the dynamics function
+	std::vector<double> errNorm;   // per accepted step, if options.recordErrors
+	RunSummary summary;            // instrumentation (see profile.h)
+
+	AdaptiveStats() : nAccept(0), nReject(0), nEval(0) {}
+};
+
+
+/******************************************************************************
+ *                        Fixed-Step Method Dispatch                          *
+ ******************************************************************************/
+
+/* Takes one fixed step with the chosen method */
+template <class Dyn>
+void methodStep(Dyn& dynFun, IntegrationMethod method,
+                double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+                StepperWorkspace& work)
+{
+	switch (method) {
+	case Euler:
+		eulerStep(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case MidPoint:
+		midPointStep(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case RungeKutta:
+		rungeKuttaStep(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case RK_2:
+		rk2step(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case RK_4A:
+		rk4Astep(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case RK_4B:
+		rk4Bstep(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case RK_45:
+		rk45step(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case RK_5:
+		rk5step(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case RK_10:
+		rk10step(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case RK_DP5:
+		dp5step(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case StormerVerlet:
+		svStep(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case Yoshida4:
+		yoshida4Step(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case Yoshida6:
+		yoshida6Step(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case Yoshida8:
+		yoshida8Step(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case BlanesMoan:
+		bm4Step(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case SDIRK_3:
+		sdirk3Step(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case RADAU_5:
+		radau5Step(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case BDF_2:
+		bdf2Step(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case BDF_5:
+		bdf5Step(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case LSRK_3:
+		williamson3Step(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case LSRK_4:
+		ck4Step(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case SSPRK_3:
+		ssp3Step(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case SSPRK_4:
+		ssp104Step(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case ARK_4:
+		ark4Step(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	}
+}
+
+
+/******************************************************************************
+ *                        Adaptive Step-Size Control                          *
+ ******************************************************************************/
+
+/* True if the method has an embedded error estimate (see simulateAdaptive) */
+bool hasErrorEstimate(IntegrationMethod method);
+
+/* Takes one step with an embedded error estimate, and returns the order of
+ * the embedded (lower-order) solution, which sets the controller exponent. */
+template <class Dyn>
+int embeddedStep(Dyn& dynFun, IntegrationMethod method,
+                 double tLow, double tUpp, double zLow[], double zUpp[],
+                 double zErr[], int nDim, StepperWorkspace& work)
+{
+	switch (method) {
+	case RK_45:
+		rk45stepErr(dynFun, tLow, tUpp, zLow, zUpp, zErr, nDim, work); return 4;
+	case RK_10:
+		rk10stepErr(dynFun, tLow, tUpp, zLow, zUpp, zErr, nDim, work); return 8;
+	case RK_DP5:
+		dp5stepErr(dynFun, tLow, tUpp, zLow, zUpp, zErr, nDim, work); return 4;
+	default:
+		throw std::invalid_argument("integration method has no error estimate");
+	}
+}
+
+/* Scaled RMS norm of the error estimate. A value <= 1 meets the tolerances. */
+double errorNorm(double zLow[], double zUpp[], double zErr[], int nDim,
+                 const AdaptiveOptions& options);
+
+/* The step-size controller of simulateAdaptive: accepts or rejects each
+ * trial step by its error norm, and picks the size of the next one. */
+class StepSizeController {
+public:
+	/* Throws std::invalid_argument unless relTol or absTol is positive */
+	StepSizeController(const AdaptiveOptions& options, double dtMax);
+
+	/* Judges a trial step of size dt with error norm err, taken by a method
+	 * whose embedded solution has the given order. Returns true to accept
+	 * it, and sets dt to the size of the next trial step. A non-finite err
+	 * (NaN or infinite dynamics) is a rejection with the smallest step
+	 * ratio. Throws std::runtime_error when a rejected step cannot shrink
+	 * any further, rather than retry it forever. */
+	bool judge(double err, int order, double& dt);
+
+private:
+	double dtMin;
+	double dtMax;
+	bool lastRejected;
 };
 
-void RK_STEP(DynFun dynFun,
-             double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
-             double A[], double B[], double C[], int nStage);
 
-void simulate(DynFun dynFun,double t0, double t1, 
-	double z0[], double z1[], int nDim, int nStep, 
-	IntegrationMethod method);
+/******************************************************************************
+ *                      Simulation Wrapper Function                           *
+ ******************************************************************************/
+
+/* The step loop of simulate: nStep fixed steps from t0 to t1. After every
+ * step from (tLow, zLow) to (tUpp, zUpp) it calls
+ *     onStep(tLow, tUpp, zLow, zUpp, work, lastStep)
+ * which returns false to end the run early, at the (tUpp, zUpp) it leaves
+ * behind (it may move them back, e.g. to an event). The final state goes
+ * to z1, and the final time is returned. Steps and buffers are accounted
+ * to the profiler. With a checkpoint, the loop resumes from the one it has
+ * loaded, saves the run to it as it goes, and leaves the final state in it
+ * (see checkpoint.h). needLow = false tells that onStep does not read zLow:
+ * the methods that can (stepsInPlace) then step in place on a single
+ * buffer, and zLow == zUpp in onStep. */
+template <class Dyn, class OnStep>
+double fixedLoop(Dyn& dynFun, double t0, double t1, double z0[], double z1[],
+                 int nDim, int nStep, IntegrationMethod method,
+                 RunProfiler& profiler, OnStep onStep, Checkpoint* checkpoint = 0,
+                 bool needLow = true)
+{
+	double dt, tLow, tUpp;
+	double *zLow;
+	double *zUpp;
+	StepperWorkspace *work;
+	bool inPlace = !needLow && stepsInPlace(method);
+
+	/// Allocate memory:
+	{
+		PhaseTimer timer(profiler, PhaseAlloc);
+		zLow = new double[nDim];
+		zUpp = inPlace ? zLow : new double[nDim];
+		work = new StepperWorkspace(nDim, methodWorkspaceStages(method));
+	}
+
+	/// Initial conditions, or the state of the checkpoint to resume from:
+	int iStart = 0;
+	tLow = t0;
+	for (int i = 0; i < nDim; i++) {
+		zLow[i] = z0[i];
+	}
+	if (checkpoint && checkpoint->begin(method, nDim, t0, t1, nStep)) {
+		const CheckpointState& saved = checkpoint->saved();
+		iStart = (int) saved.nAccept;
+		tLow = saved.t;
+		restoreStepperState(saved, zLow, *work);
+	}
+	int nDone = iStart;
+
+	/// March forward in time:
+	dt = (t1 - t0) / ((double) nStep);
+	for (int i = iStart; i < nStep; i++) {
+		tUpp = tLow + dt;
+		{
+			StepTimer timer(profiler);
+			methodStep(dynFun, method, tLow, tUpp, zLow, zUpp, nDim, *work);
+		}
+		if (INSTRUMENTED) {
+			profiler.summary.nAccept++;
+		}
+		bool keepGoing = onStep(tLow, tUpp, zLow, zUpp, *work, i == nStep - 1);
+
+		/// Advance temp variables:
+		tLow = tUpp;
+		if (!inPlace) {
+			for (int j = 0; j < nDim; j++) {
+				zLow[j] = zUpp[j];
+			}
+		}
+		nDone++;
+		if (!keepGoing) {
+			break;
+		}
+		if (checkpoint && checkpoint->due()) {
+			PhaseTimer timer(profiler, PhaseLogging);
+			checkpoint->save(tLow, zLow, dt, *work, nDone, 0, 0);
+		}
+	}
+
+	for (int i = 0; i < nDim; i++) {
+		z1[i] = zLow[i];
+	}
+	if (checkpoint) {
+		PhaseTimer timer(profiler, PhaseLogging);
+		checkpoint->save(tLow, zLow, dt, *work, nDone, 0, 0);
+		checkpoint->wait();
+	}
+
+	{
+		PhaseTimer timer(profiler, PhaseAlloc);
+		if (!inPlace) {
+			delete [] zUpp;
+		}
+		delete [] zLow;
+		delete work;
+	}
+
+	return tLow;
+}
+
+/* Runs nStep fixed time steps from t0 to t1 with the chosen method, passing
+ * every step to the sink and returning the final state in z1. dynFun is
+ * taken by value, like the function objects of the standard algorithms:
+ * wrap it in std::ref to share state.
+ * Returns the run's instrumentation summary (all zero unless built with
+ * RK_INSTRUMENT, see profile.h). */
+template <class Dyn>
+RunSummary simulate(Dyn dynFun, double t0, double t1, double z0[], double z1[],
+                    int nDim, int nStep, IntegrationMethod method, TrajectorySink& sink)
+{
+	RunProfiler profiler;
+	auto&& dyn = profiledDynamics(dynFun, profiler);
+	auto&& log = profiledSink(sink, profiler);
+	log.record(t0, z0, nDim);
+	fixedLoop(dyn, t0, t1, z0, z1, nDim, nStep, method, profiler,
+		[&](double, double tUpp, double[], double zUpp[], StepperWorkspace&, bool) {
+			log.record(tUpp, zUpp, nDim);
+			return true;
+		}, 0, false);
+	log.flush();
+	return profiler.finish();
+}
+
+/* simulate with checkpoints (see checkpoint.h): resumes from the
+ * checkpoint's file if there is one, saves the run to it every few seconds
+ * as it goes, and leaves the final state in it. The sink is flushed at
+ * every checkpoint and resumed with the run; open a BinarySink in append
+ * mode to have one file hold the whole trajectory across restarts. */
+template <class Dyn>
+RunSummary simulate(Dyn dynFun, double t0, double t1, double z0[], double z1[],
+                    int nDim, int nStep, IntegrationMethod method, TrajectorySink& sink,
+                    Checkpoint& checkpoint)
+{
+	RunProfiler profiler;
+	auto&& dyn = profiledDynamics(dynFun, profiler);
+	auto&& log = profiledSink(sink, profiler);
+	FollowedSink followed(checkpoint, sink);
+	if (!checkpoint.load()) {
+		log.resume(-std::numeric_limits<double>::infinity());   // nothing of an earlier run
+		log.record(t0, z0, nDim);
+	}
+	fixedLoop(dyn, t0, t1, z0, z1, nDim, nStep, method, profiler,
+		[&](double, double tUpp, double[], double zUpp[], StepperWorkspace&, bool) {
+			log.record(tUpp, zUpp, nDim);
+			return true;
+		}, &checkpoint, false);
+	log.flush();
+	return profiler.finish();
+}
+
+/* simulate with dense output: takes nStep fixed steps, but passes the solution
+ * to the sink only at the times in tOut (ascending, within [t0, t1]),
+ * interpolated inside each step (see DenseOutput). The steps can then be as
+ * long as accuracy allows, whatever resolution the output needs. */
+template <class Dyn>
+RunSummary simulate(Dyn dynFun, double t0, double t1, double z0[], double z1[],
+                    int nDim, int nStep, IntegrationMethod method,
+                    const std::vector<double>& tOut, TrajectorySink& sink)
+{
+	checkOutputTimes(tOut, t0, t1);
+	RunProfiler profiler;
+	auto&& dyn = profiledDynamics(dynFun, profiler);
+	auto&& log = profiledSink(sink, profiler);
+	DenseOutput dense(nDim, method);
+	size_t iOut = 0;
+	fixedLoop(dyn, t0, t1, z0, z1, nDim, nStep, method, profiler,
+		[&](double tLow, double tUpp, double zLow[], double zUpp[],
+		    StepperWorkspace& work, bool lastStep) {
+			dense.emit(dyn, tLow, tUpp, zLow, zUpp, work, tOut, iOut, lastStep, log);
+			return true;
+		});
+	log.flush();
+	return profiler.finish();
+}
+
+/* simulate with event detection: after every step the guards of the events
+ * are checked, and each zero crossing is located on the step's interpolant
+ * and reported in the result. An EventTerminate event ends the run there,
+ * with z1 = the state at the event. Every step is passed to the sink, the
+ * last one cut short at a terminating event. The instrumentation summary
+ * is in result.summary. */
+template <class Dyn>
+EventResult simulate(Dyn dynFun, double t0, double t1, double z0[], double z1[],
+                     int nDim, int nStep, IntegrationMethod method,
+                     const std::vector<Event>& events, TrajectorySink& sink)
+{
+	EventResult result;
+	RunProfiler profiler;
+	auto&& dyn = profiledDynamics(dynFun, profiler);
+	auto&& log = profiledSink(sink, profiler);
+	EventLocator locator(events, nDim, method);
+	locator.start(t0, z0);
+	log.record(t0, z0, nDim);
+	result.tEnd = fixedLoop(dyn, t0, t1, z0, z1, nDim, nStep, method, profiler,
+		[&](double tLow, double& tUpp, double zLow[], double zUpp[],
+		    StepperWorkspace& work, bool) {
+			bool keepGoing = locator.check(dyn, tLow, tUpp, zLow, zUpp, work, result.hits);
+			log.record(tUpp, zUpp, nDim);
+			result.terminated = !keepGoing;
+			return keepGoing;
+		});
+	log.flush();
+	result.summary = profiler.finish();
+	return result;
+}
+
+/* simulate, writing the trajectory to the binary file "logFile.traj" from a
+ * background thread */
+template <class Dyn>
+RunSummary simulate(Dyn dynFun, double t0, double t1, double z0[], double z1[],
+                    int nDim, int nStep, IntegrationMethod method)
+{
+	AsyncSink logFile(std::unique_ptr<TrajectorySink>(new BinarySink("logFile.traj", method)));
+	return simulate(dynFun, t0, t1, z0, z1, nDim, nStep, method, logFile);
+}
+
+
+/* The step loop of simulateAdaptive. After every accepted step it calls
+ *     onStep(tLow, tUpp, zLow, zUpp, work, lastStep)
+ * with the same contract as in fixedLoop, and it takes a checkpoint the
+ * same way. The final state goes to z1. */
+template <class Dyn, class OnStep>
+AdaptiveStats adaptiveLoop(Dyn& dynFun, double t0, double t1,
+                           double z0[], double z1[], int nDim,
+                           IntegrationMethod method, const AdaptiveOptions& options,
+                           RunProfiler& profiler, OnStep onStep, Checkpoint* checkpoint = 0)
+{
+	if (!hasErrorEstimate(method)) {
+		throw std::invalid_argument("simulateAdaptive: method has no error estimate");
+	}
+
+	AdaptiveStats stats;
+	int nStage = methodStageCount(method);
+	auto counted = countedDynamics(dynFun, stats.nEval);
+
+	/// Allocate memory:
+	double *zLow, *zUpp, *zErr;
+	StepperWorkspace *work;
+	{
+		PhaseTimer timer(profiler, PhaseAlloc);
+		zLow = new double[nDim];
+		zUpp = new double[nDim];
+		zErr = new double[nDim];
+		work = new StepperWorkspace(nDim, nStage);
+	}
+
+	/// Initial conditions
+	double tLow = t0;
+	for (int i = 0; i < nDim; i++) {
+		zLow[i] = z0[i];
+	}
+
+	double dtMax = options.dtMax > 0.0 ? options.dtMax : (t1 - t0);
+	double dt = options.dtInit > 0.0 ? options.dtInit : (t1 - t0) / 100.0;
+	dt = std::min(dt, dtMax);
+	StepSizeController controller(options, dtMax);
+
+	/// Resume from a checkpoint. It is taken after an accepted step, when
+	/// the controller holds nothing but dt.
+	if (checkpoint && checkpoint->begin(method, nDim, t0, t1, 0)) {
+		const CheckpointState& saved = checkpoint->saved();
+		tLow = saved.t;
+		dt = saved.dt;
+		stats.nAccept = (int) saved.nAccept;
+		stats.nReject = (int) saved.nReject;
+		stats.nEval = (int) saved.nEval;
+		restoreStepperState(saved, zLow, *work);
+	}
+
+	/// March forward in time:
+	while (tLow < t1) {
+		bool lastStep = tLow + dt >= t1;
+		double tUpp = lastStep ? t1 : tLow + dt;
+		if (!(tUpp > tLow)) {
+			throw std::runtime_error("simulateAdaptive: step size underflow");
+		}
+		int order;
+		{
+			StepTimer timer(profiler);
+			order = embeddedStep(counted, method, tLow, tUpp, zLow, zUpp, zErr, nDim, *work);
+		}
+
+		double err = errorNorm(zLow, zUpp, zErr, nDim, options);
+		if (controller.judge(err, order, dt)) {
+			/// Accept the step:
+			stats.nAccept++;
+			bool keepGoing = onStep(tLow, tUpp, zLow, zUpp, *work, lastStep);
+			tLow = tUpp;
+			for (int j = 0; j < nDim; j++) {
+				zLow[j] = zUpp[j];
+			}
+			if (options.recordErrors) {
+				stats.errNorm.push_back(err);
+			}
+			if (!keepGoing) {
+				break;
+			}
+			if (checkpoint && checkpoint->due()) {
+				PhaseTimer timer(profiler, PhaseLogging);
+				checkpoint->save(tLow, zLow, dt, *work, stats.nAccept, stats.nReject, stats.nEval);
+			}
+		} else {
+			stats.nReject++;
+		}
+	}
+
+	for (int i = 0; i < nDim; i++) {
+		z1[i] = zLow[i];
+	}
+	if (checkpoint) {
+		PhaseTimer timer(profiler, PhaseLogging);
+		checkpoint->save(tLow, zLow, dt, *work, stats.nAccept, stats.nReject, stats.nEval);
+		checkpoint->wait();
+	}
+
+	{
+		PhaseTimer timer(profiler, PhaseAlloc);
+		delete [] zLow;
+		delete [] zUpp;
+		delete [] zErr;
+		delete work;
+	}
+
+	if (INSTRUMENTED) {
+		profiler.summary.nAccept = stats.nAccept;
+		profiler.summary.nReject = stats.nReject;
+	}
+	return stats;
+}
+
+/* Runs a simulation from t0 to t1 with a variable time step. Each step is
+ * checked against the method's embedded error estimate: steps that fail the
+ * tolerances are repeated with a smaller dt, and dt grows again while the
+ * solution is smooth. Every accepted step is passed to the sink, and the
+ * final state is returned in z1.
+ * Only methods for which hasErrorEstimate() is true are supported. With
+ * RK_INSTRUMENT, stats.summary holds the run's instrumentation summary. */
+template <class Dyn>
+AdaptiveStats simulateAdaptive(Dyn dynFun, double t0, double t1,
+                               double z0[], double z1[], int nDim,
+                               IntegrationMethod method, const AdaptiveOptions& options,
+                               TrajectorySink& sink)
+{
+	RunProfiler profiler;
+	auto&& dyn = profiledDynamics(dynFun, profiler);
+	auto&& log = profiledSink(sink, profiler);
+	log.record(t0, z0, nDim);
+	AdaptiveStats stats = adaptiveLoop(dyn, t0, t1, z0, z1, nDim, method, options, profiler,
+		[&](double, double tUpp, double[], double zUpp[], StepperWorkspace&, bool) {
+			log.record(tUpp, zUpp, nDim);
+			return true;
+		});
+	log.flush();
+	stats.summary = profiler.finish();
+	return stats;
+}
+
+/* simulateAdaptive with checkpoints, as the checkpoint overload of
+ * simulate. The resumed run's stats count the steps from t0, except
+ * stats.errNorm, which only has those taken since the restart. */
+template <class Dyn>
+AdaptiveStats simulateAdaptive(Dyn dynFun, double t0, double t1,
+                               double z0[], double z1[], int nDim,
+                               IntegrationMethod method, const AdaptiveOptions& options,
+                               TrajectorySink& sink, Checkpoint& checkpoint)
+{
+	RunProfiler profiler;
+	auto&& dyn = profiledDynamics(dynFun, profiler);
+	auto&& log = profiledSink(sink, profiler);
+	FollowedSink followed(checkpoint, sink);
+	if (!checkpoint.load()) {
+		log.resume(-std::numeric_limits<double>::infinity());   // nothing of an earlier run
+		log.record(t0, z0, nDim);
+	}
+	AdaptiveStats stats = adaptiveLoop(dyn, t0, t1, z0, z1, nDim, method, options, profiler,
+		[&](double, double tUpp, double[], double zUpp[], StepperWorkspace&, bool) {
+			log.record(tUpp, zUpp, nDim);
+			return true;
+		}, &checkpoint);
+	log.flush();
+	stats.summary = profiler.finish();
+	return stats;
+}
+
+/* simulateAdaptive with dense output: the sink gets the solution only at the
+ * times in tOut (ascending, within [t0, t1]), interpolated inside the
+ * accepted steps, so the output grid has no effect on the step sizes. */
+template <class Dyn>
+AdaptiveStats simulateAdaptive(Dyn dynFun, double t0, double t1,
+                               double z0[], double z1[], int nDim,
+                               IntegrationMethod method, const AdaptiveOptions& options,
+                               const std::vector<double>& tOut, TrajectorySink& sink)
+{
+	checkOutputTimes(tOut, t0, t1);
+	RunProfiler profiler;
+	auto&& dyn = profiledDynamics(dynFun, profiler);
+	auto&& log = profiledSink(sink, profiler);
+	DenseOutput dense(nDim, method);
+	size_t iOut = 0;
+	AdaptiveStats stats = adaptiveLoop(dyn, t0, t1, z0, z1, nDim, method, options, profiler,
+		[&](double tLow, double tUpp, double zLow[], double zUpp[],
+		    StepperWorkspace& work, bool lastStep) {
+			dense.emit(dyn, tLow, tUpp, zLow, zUpp, work, tOut, iOut, lastStep, log);
+			return true;
+		});
+	stats.nEval += dense.nEval();
+	log.flush();
+	stats.summary = profiler.finish();
+	return stats;
+}
+
+/* simulateAdaptive with event detection (see the event overload of
+ * simulate). Events are reported in result. */
+template <class Dyn>
+AdaptiveStats simulateAdaptive(Dyn dynFun, double t0, double t1,
+                               double z0[], double z1[], int nDim,
+                               IntegrationMethod method, const AdaptiveOptions& options,
+                               const std::vector<Event>& events, EventResult& result,
+                               TrajectorySink& sink)
+{
+	result = EventResult();
+	result.tEnd = t1;
+	RunProfiler profiler;
+	auto&& dyn = profiledDynamics(dynFun, profiler);
+	auto&& log = profiledSink(sink, profiler);
+	EventLocator locator(events, nDim, method);
+	locator.start(t0, z0);
+	log.record(t0, z0, nDim);
+	AdaptiveStats stats = adaptiveLoop(dyn, t0, t1, z0, z1, nDim, method, options, profiler,
+		[&](double tLow, double& tUpp, double zLow[], double zUpp[],
+		    StepperWorkspace& work, bool) {
+			bool keepGoing = locator.check(dyn, tLow, tUpp, zLow, zUpp, work, result.hits);
+			log.record(tUpp, zUpp, nDim);
+			if (!keepGoing) {
+				result.terminated = true;
+				result.tEnd = tUpp;
+			}
+			return keepGoing;
+		});
+	stats.nEval += locator.nEval();
+	log.flush();
+	stats.summary = profiler.finish();
+	result.summary = stats.summary;
+	return stats;
+}
+
+/* simulateAdaptive, writing the trajectory to the binary file "logFile.traj"
+ * from a background thread */
+template <class Dyn>
+AdaptiveStats simulateAdaptive(Dyn dynFun, double t0, double t1,
+                               double z0[], double z1[], int nDim,
+                               IntegrationMethod method, const AdaptiveOptions& options)
+{
+	AsyncSink logFile(std::unique_ptr<TrajectorySink>(
+		new BinarySink("logFile.traj", method, options.relTol, options.absTol)));
+	return simulateAdaptive(dynFun, t0, t1, z0, z1, nDim, method, options, logFile);
+}
+
+
+/******************************************************************************
+ *                          Ensemble Simulation                               *
+ ******************************************************************************/
+
+/* Batched dynamics for simulateEnsemble: dynFun(t, z, dz, nTraj) evaluates
+ * all nTraj trajectories at once. States are stored structure-of-arrays:
+ * component iDim of trajectory k is z[iDim * nTraj + k]. */
+typedef void (*BatchDynFun)(double, double[], double[], int);
+
+/* Integrates nTraj trajectories of the same system in lockstep, with nStep
+ * fixed steps from t0 to t1. z0 and z1 are nDim * nTraj structure-of-arrays
+ * states (see BatchDynFun); z1 receives the final states. Nothing is logged.
+ *
+ * The ensemble is stepped as one state of size nDim * nTraj, so the tableau
+ * is walked once per step for the whole batch, the stage combination loops
+ * run contiguously across trajectories (and vectorize), and the workspace
+ * is shared by every trajectory. */
+template <class BatchDyn>
+void simulateEnsemble(BatchDyn dynFun, double t0, double t1, double z0[], double z1[],
+                      int nDim, int nTraj, int nStep, IntegrationMethod method)
+{
+	int nFlat = nDim * nTraj;
+	auto flatFun = [&dynFun, nTraj](double t, double z[], double dz[]) {
+		dynFun(t, z, dz, nTraj);
+	};
+
+	/// Allocate memory (one state buffer for the methods that step in place):
+	bool inPlace = stepsInPlace(method);
+	double *zLow = new double[nFlat];
+	double *zUpp = inPlace ? zLow : new double[nFlat];
+	StepperWorkspace work(nFlat, methodWorkspaceStages(method));
+
+	/// Initial conditions
+	double tLow = t0;
+	for (int i = 0; i < nFlat; i++) {
+		zLow[i] = z0[i];
+	}
+
+	/// March forward in time:
+	double dt = (t1 - t0) / ((double) nStep);
+	for (int i = 0; i < nStep; i++) {
+		double tUpp = (i == nStep - 1) ? t1 : tLow + dt;
+		methodStep(flatFun, method, tLow, tUpp, zLow, zUpp, nFlat, work);
+		tLow = tUpp;
+		std::swap(zLow, zUpp);
+	}
+
+	for (int i = 0; i < nFlat; i++) {
+		z1[i] = zLow[i];
+	}
+
+	if (!inPlace) {
+		delete [] zUpp;
+	}
+	delete [] zLow;
+}
+
+
+/******************************************************************************
+ *                       Multithreaded Simulation                             *
+ ******************************************************************************/
+
+/* Lets a chunked dynamics function, dynFun(t, z, dz, iBegin, iEnd), which
+ * fills only dz[iBegin ... iEnd-1], be called like any other dynamics
+ * function: each call is split across the pool, with the same chunks (and
+ * therefore the same cores) as the stage updates. */
+template <class ChunkDyn>
+struct ChunkedDynamics {
+	ChunkDyn& dynFun;
+	ThreadPool& pool;
+	int nDim;
+
+	void operator()(double t, double z[], double dz[]) {
+		pool.parallelFor(nDim, PARALLEL_CHUNK, [&](int iBegin, int iEnd) {
+			dynFun(t, z, dz, iBegin, iEnd);
+		});
+	}
+};
+
+/* Runs nStep fixed steps from t0 to t1 like simulate, for very large states:
+ * a pool of nThread threads (<= 0: one per hardware thread) is created once
+ * for the run, and every stage update is split across it in cache-sized
+ * chunks. dynFun is either an ordinary dynamics function, called from one
+ * thread, or a chunked one, dynFun(t, z, dz, iBegin, iEnd), which then runs
+ * on the pool with the same chunking. Nothing is logged; the final state is
+ * returned in z1. */
+template <class Dyn>
+void simulateParallel(Dyn dynFun, double t0, double t1, double z0[], double z1[],
+                      int nDim, int nStep, IntegrationMethod method, int nThread)
+{
+	ThreadPool pool(nThread);
+
+	/// Allocate memory (one state buffer for the methods that step in place):
+	bool inPlace = stepsInPlace(method);
+	double *zLow = new double[nDim];
+	double *zUpp = inPlace ? zLow : new double[nDim];
+	StepperWorkspace work(nDim, methodWorkspaceStages(method));
+	work.setPool(&pool);
+
+	/// Initial conditions (copied by the threads that will own each chunk):
+	pool.parallelFor(nDim, PARALLEL_CHUNK, [&](int iBegin, int iEnd) {
+		for (int i = iBegin; i < iEnd; i++) {
+			zLow[i] = z0[i];
+			if (!inPlace) {
+				zUpp[i] = 0.0;
+			}
+		}
+	});
+
+	/// March forward in time:
+	auto march = [&](auto& stepFun) {
+		double tLow = t0;
+		double dt = (t1 - t0) / ((double) nStep);
+		for (int i = 0; i < nStep; i++) {
+			double tUpp = (i == nStep - 1) ? t1 : tLow + dt;
+			methodStep(stepFun, method, tLow, tUpp, zLow, zUpp, nDim, work);
+			tLow = tUpp;
+			std::swap(zLow, zUpp);
+		}
+	};
+	if constexpr (std::is_invocable<Dyn&, double, double*, double*, int, int>::value) {
+		ChunkedDynamics<Dyn> chunked = {dynFun, pool, nDim};
+		march(chunked);
+	} else {
+		march(dynFun);
+	}
+
+	for (int i = 0; i < nDim; i++) {
+		z1[i] = zLow[i];
+	}
+
+	if (!inPlace) {
+		delete [] zUpp;
+	}
+	delete [] zLow;
+}
+
+/* Compiled once, in integrator.cpp, for plain function pointers */
+extern template RunSummary simulate<DynFun>(DynFun, double, double, double[], double[],
+                                            int, int, IntegrationMethod);
+extern template RunSummary simulate<DynFun>(DynFun, double, double, double[], double[],
+                                            int, int, IntegrationMethod, TrajectorySink&);
+extern template RunSummary simulate<DynFun>(DynFun, double, double, double[], double[],
+                                            int, int, IntegrationMethod, TrajectorySink&, Checkpoint&);
+extern template AdaptiveStats simulateAdaptive<DynFun>(DynFun, double, double,
+                                                       double[], double[], int,
+                                                       IntegrationMethod,
+                                                       const AdaptiveOptions&);
+extern template AdaptiveStats simulateAdaptive<DynFun>(DynFun, double, double,
+                                                       double[], double[], int,
+                                                       IntegrationMethod,
+                                                       const AdaptiveOptions&,
+                                                       TrajectorySink&);
+extern template AdaptiveStats simulateAdaptive<DynFun>(DynFun, double, double,
+                                                       double[], double[], int,
+                                                       IntegrationMethod,
+                                                       const AdaptiveOptions&,
+                                                       TrajectorySink&, Checkpoint&);
+extern template void simulateEnsemble<BatchDynFun>(BatchDynFun, double, double,
+                                                   double[], double[], int, int, int,
+                                                   IntegrationMethod);
+extern template void simulateParallel<DynFun>(DynFun, double, double, double[], double[],
+                                              int, int, IntegrationMethod, int);
 
-#endif
\ No newline at end of file
+#endif
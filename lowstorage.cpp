@@ -0,0 +1,10 @@
+#include "lowstorage.h"
+
+template void williamson3Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                      StepperWorkspace&);
+template void ck4Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                              StepperWorkspace&);
+template void ssp3Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                               StepperWorkspace&);
+template void ssp104Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                 StepperWorkspace&);
@@ -0,0 +1,260 @@
+#ifndef __LOWSTORAGE_H__
+#define __LOWSTORAGE_H__
+
+#include <algorithm>
+#include <iterator>
+
+#include "stepper.h"
+
+/* Low-storage Runge-Kutta methods, for states too large for RK_STEP's
+ * nStage stage states and derivatives. They overwrite the new state in
+ * place, stage by stage, and keep one or two more registers besides the
+ * derivative dz[] that the dynamics function writes:
+ *
+ * 2N (Williamson) form, registers zUpp and dq:
+ *     dq = A[i] dq + dt f(tLow + c[i] dt, zUpp)
+ *     zUpp += B[i] dq
+ * zUpp may be zLow itself: the step then runs in place, on one copy of
+ * the state (see stepsInPlace).
+ *
+ * 3S* (Ketcheson) form, registers zUpp (S1), S2 and zLow itself (S3):
+ *     S2 += delta[i] S1
+ *     S1 = gamma1[i] S1 + gamma2[i] S2 + gamma3[i] S3 + beta[i] dt f(tLow + c[i] dt, S1)
+ * with S1 = zLow and S2 = 0 at the start. A tableau whose deltas are all
+ * zero (the 2S* form) never touches S2.
+ *
+ * Each stage is one fused pass over the registers, split across the
+ * workspace's thread pool when it has one. */
+
+/* The loop body of a stage over components [iBegin, iEnd), on the pool
+ * for a large state */
+template <class Body>
+inline void registerPass(StepperWorkspace& work, int nDim, Body body) {
+	ThreadPool *pool = work.pool();
+	if (pool && nDim >= SIMD_MIN_DIM) {
+		pool->parallelFor(nDim, PARALLEL_CHUNK, body);
+	} else {
+		body(0, nDim);
+	}
+}
+
+
+/******************************************************************************
+ *                           2N Methods                                       *
+ ******************************************************************************/
+
+/* Williamson's 3-stage, 3rd-order 2N method */
+struct Williamson3__Tableau {
+	static constexpr int nStage = 3;
+	static constexpr double A[] = {0.0, -5.0 / 9.0, -153.0 / 128.0};
+	static constexpr double B[] = {1.0 / 3.0, 15.0 / 16.0, 8.0 / 15.0};
+	static constexpr double C[] = {0.0, 1.0 / 3.0, 3.0 / 4.0};
+};
+
+/* Carpenter and Kennedy's 5-stage, 4th-order 2N method (solution 3) */
+struct CK4__Tableau {
+	static constexpr int nStage = 5;
+	static constexpr double A[] = {
+		0.0,
+		-567301805773.0 / 1357537059087.0,
+		-2404267990393.0 / 2016746695238.0,
+		-3550918686646.0 / 2091501179385.0,
+		-1275806237668.0 / 842570457699.0
+	};
+	static constexpr double B[] = {
+		1432997174477.0 / 9575080441755.0,
+		5161836677717.0 / 13612068292357.0,
+		1720146321549.0 / 2090206949498.0,
+		3134564353537.0 / 4481467310338.0,
+		2277821191437.0 / 14882151754819.0
+	};
+	static constexpr double C[] = {
+		0.0,
+		1432997174477.0 / 9575080441755.0,
+		2526269341429.0 / 6820363962896.0,
+		2006345519317.0 / 3224310063776.0,
+		2802321613138.0 / 2924317926251.0
+	};
+};
+
+/* One step of a 2N method. Arguments match RK_STEP, except that zUpp may
+ * be zLow; the workspace needs one stage (dq in z(0), dz in f(0)). */
+template <class Tableau, class Dyn>
+void LOW_STORAGE_2N_STEP(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[],
+                         int nDim, StepperWorkspace& work)
+{
+	static_assert(std::size(Tableau::A) == Tableau::nStage, "A[] needs nStage entries");
+	static_assert(std::size(Tableau::B) == Tableau::nStage, "B[] needs nStage entries");
+	static_assert(std::size(Tableau::C) == Tableau::nStage, "C[] needs nStage entries");
+	static_assert(Tableau::A[0] == 0.0, "A[0] must be zero");
+
+	double dt = tUpp - tLow;
+	double *dq = work.z(0);
+	double *f = work.f(0);
+	work.clearLastStage();
+	if (zUpp != zLow) {
+		std::copy(zLow, zLow + nDim, zUpp);
+	}
+
+	for (int iStage = 0; iStage < Tableau::nStage; iStage++) {
+		dynFun(tLow + Tableau::C[iStage] * dt, zUpp, f);
+		double a = Tableau::A[iStage], b = Tableau::B[iStage];
+		registerPass(work, nDim, [&](int iBegin, int iEnd) {
+			if (iStage == 0) {   // dq holds nothing yet
+				for (int i = iBegin; i < iEnd; i++) {
+					dq[i] = dt * f[i];
+					zUpp[i] += b * dq[i];
+				}
+				return;
+			}
+			for (int i = iBegin; i < iEnd; i++) {
+				dq[i] = a * dq[i] + dt * f[i];
+				zUpp[i] += b * dq[i];
+			}
+		});
+	}
+}
+
+
+/******************************************************************************
+ *                           3S* Methods                                      *
+ ******************************************************************************/
+
+/* The 3-stage, 3rd-order strong-stability-preserving method of Shu and
+ * Osher, written in 3S* form (all deltas zero: two registers) */
+struct SSP3__Tableau {
+	static constexpr int nStage = 3;
+	static constexpr double Gamma1[] = {1.0, 1.0 / 4.0, 2.0 / 3.0};
+	static constexpr double Gamma2[] = {0.0, 0.0, 0.0};
+	static constexpr double Gamma3[] = {0.0, 3.0 / 4.0, 1.0 / 3.0};
+	static constexpr double Beta[] = {1.0, 1.0 / 4.0, 2.0 / 3.0};
+	static constexpr double Delta[] = {0.0, 0.0, 0.0};
+	static constexpr double C[] = {0.0, 1.0, 1.0 / 2.0};
+};
+
+/* Ketcheson's 10-stage, 4th-order strong-stability-preserving method
+ * SSPRK(10,4), SSP coefficient 6, in 3S* form. Its Shu-Osher form is
+ *     q1 = q2 = zLow
+ *     5 times: q1 += dt/6 f(q1)
+ *     q2 = q2/25 + 9 q1/25;  q1 = 15 q2 - 5 q1
+ *     4 times: q1 += dt/6 f(q1)
+ *     zUpp = q2 + 3 q1/5 + dt/10 f(q1)
+ * The fifth update and the restart fold into stage 4 (S1 = 3 zLow/5 +
+ * 2 q1/5), which makes q2 = 9 S1/10 - zLow/2 after it: S2 gathers 9/10 of
+ * S1 at stage 5, and the last stage takes the -zLow/2 from S3. */
+struct SSP104__Tableau {
+	static constexpr int nStage = 10;
+	static constexpr double Gamma1[] = {
+		1.0, 1.0, 1.0, 1.0, 2.0 / 5.0, 1.0, 1.0, 1.0, 1.0, 3.0 / 5.0
+	};
+	static constexpr double Gamma2[] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 1.0};
+	static constexpr double Gamma3[] = {
+		0.0, 0.0, 0.0, 0.0, 3.0 / 5.0, 0.0, 0.0, 0.0, 0.0, -1.0 / 2.0
+	};
+	static constexpr double Beta[] = {
+		1.0 / 6.0, 1.0 / 6.0, 1.0 / 6.0, 1.0 / 6.0, 1.0 / 15.0,
+		1.0 / 6.0, 1.0 / 6.0, 1.0 / 6.0, 1.0 / 6.0, 1.0 / 10.0
+	};
+	static constexpr double Delta[] = {0.0, 0.0, 0.0, 0.0, 0.0, 9.0 / 10.0, 0.0, 0.0, 0.0, 0.0};
+	static constexpr double C[] = {
+		0.0, 1.0 / 6.0, 1.0 / 3.0, 1.0 / 2.0, 2.0 / 3.0,
+		1.0 / 3.0, 1.0 / 2.0, 2.0 / 3.0, 5.0 / 6.0, 1.0
+	};
+};
+
+/* True if a 3S* tableau uses the register S2 */
+template <class Tableau>
+constexpr bool usesSecondRegister() {
+	for (double delta : Tableau::Delta) {
+		if (delta != 0.0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* One step of a 3S* method. Arguments match RK_STEP; the workspace needs
+ * one stage (S2 in z(0), dz in f(0)). zLow is register S3, so unlike the
+ * 2N step this one cannot run in place. */
+template <class Tableau, class Dyn>
+void LOW_STORAGE_3S_STEP(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[],
+                         int nDim, StepperWorkspace& work)
+{
+	const int nStage = Tableau::nStage;
+	static_assert(std::size(Tableau::Gamma1) == nStage && std::size(Tableau::Gamma2) == nStage
+	              && std::size(Tableau::Gamma3) == nStage && std::size(Tableau::Beta) == nStage
+	              && std::size(Tableau::C) == nStage, "3S* coefficients need nStage entries");
+	static_assert(std::size(Tableau::Delta) == nStage, "Delta[] needs nStage entries");
+	const bool useS2 = usesSecondRegister<Tableau>();
+
+	double dt = tUpp - tLow;
+	double *s1 = zUpp;
+	double *s2 = work.z(0);
+	const double *s3 = zLow;
+	double *f = work.f(0);
+	work.clearLastStage();
+	std::copy(zLow, zLow + nDim, s1);
+	if (useS2) {
+		std::fill(s2, s2 + nDim, 0.0);
+	}
+
+	for (int iStage = 0; iStage < nStage; iStage++) {
+		dynFun(tLow + Tableau::C[iStage] * dt, s1, f);
+		double g1 = Tableau::Gamma1[iStage], g2 = Tableau::Gamma2[iStage];
+		double g3 = Tableau::Gamma3[iStage], bdt = Tableau::Beta[iStage] * dt;
+		double delta = Tableau::Delta[iStage];
+		registerPass(work, nDim, [&](int iBegin, int iEnd) {
+			if (!useS2) {
+				for (int i = iBegin; i < iEnd; i++) {
+					s1[i] = g1 * s1[i] + g3 * s3[i] + bdt * f[i];
+				}
+				return;
+			}
+			for (int i = iBegin; i < iEnd; i++) {
+				s2[i] += delta * s1[i];
+				s1[i] = g1 * s1[i] + g2 * s2[i] + g3 * s3[i] + bdt * f[i];
+			}
+		});
+	}
+}
+
+
+/******************************************************************************
+ *                           Step Functions                                   *
+ ******************************************************************************/
+
+template <class Dyn>
+void williamson3Step(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[],
+                     int nDim, StepperWorkspace& work) {
+	LOW_STORAGE_2N_STEP<Williamson3__Tableau>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work);
+}
+
+template <class Dyn>
+void ck4Step(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+             StepperWorkspace& work) {
+	LOW_STORAGE_2N_STEP<CK4__Tableau>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work);
+}
+
+template <class Dyn>
+void ssp3Step(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+              StepperWorkspace& work) {
+	LOW_STORAGE_3S_STEP<SSP3__Tableau>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work);
+}
+
+template <class Dyn>
+void ssp104Step(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+                StepperWorkspace& work) {
+	LOW_STORAGE_3S_STEP<SSP104__Tableau>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work);
+}
+
+/* Compiled once, in lowstorage.cpp, for plain function pointers */
+extern template void williamson3Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                             StepperWorkspace&);
+extern template void ck4Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                     StepperWorkspace&);
+extern template void ssp3Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                      StepperWorkspace&);
+extern template void ssp104Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                        StepperWorkspace&);
+
+#endif
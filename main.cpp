@@ -5,6 +5,8 @@
 using namespace std;
 
 #include "integrator.h"
+#include "multirate.h"
+#include "simulation.h"
 
 
 /* Test dynamics function --  simple pendulum*/
@@ -42,6 +44,13 @@ int main()
 	DynFun dynFun = simplePendulum;
 	// DynFun dynFun = drivenDampedPendulum;
 
+	// Any callable works, e.g. a lambda that carries the model parameters:
+	// double damping = 0.1;
+	// auto dynFun = [damping](double t, double z[], double dz[]) {
+	// 	dz[0] = z[1];
+	// 	dz[1] = -damping * z[1] - sin(z[0]);
+	// };
+
 	z0[0] = 1.9;
 	z0[1] = -4.5;
 
@@ -54,8 +63,57 @@ int main()
 	IntegrationMethod method = RK_45; 			// Runge-Kutta-Fehlberg
 	// IntegrationMethod method = RK_5;  		// 5th-order Runge-Kutta
 	// IntegrationMethod method = RK_10;  		// 10th-order Runge-Kutta
+	// IntegrationMethod method = RK_DP5;  		// Dormand-Prince 5(4)
+	// IntegrationMethod method = Yoshida4;  	// Symplectic, 4th-order (undamped: drop the 0.1 * v term)
+	// IntegrationMethod method = RADAU_5;  	// Implicit Radau IIA, 5th-order, for stiff systems
+	// IntegrationMethod method = LSRK_4;  		// Low-storage 4th-order (Carpenter-Kennedy), for huge states
+	// IntegrationMethod method = ARK_4;  		// IMEX 4th-order (Kennedy-Carpenter), for split stiff/non-stiff dynamics
 
 	simulate(dynFun, t0, t1, z0, z1, nDim, nStep, method);
 
+	// Variable-step alternative (methods with an error estimate, e.g. RK_45):
+	// AdaptiveOptions options;
+	// options.relTol = 1e-8;
+	// options.absTol = 1e-8;
+	// simulateAdaptive(dynFun, t0, t1, z0, z1, nDim, method, options);
+
+	// Dense output: a few large steps, logged on a fine time grid:
+	// std::vector<double> tOut;
+	// for (int i = 0; i <= 2000; i++) tOut.push_back(t0 + (t1 - t0) * i / 2000.0);
+	// BinarySink logFile("logFile.traj", method);
+	// simulate(dynFun, t0, t1, z0, z1, nDim, 50, method, tOut, logFile);
+
+	// Step by step, reacting to the state every 0.1 s without logging it:
+	// Simulation<DynFun> sim(dynFun, t0, z0, nDim, method, dt);
+	// while (sim.time() < t1) {
+	// 	sim.advanceTo(min(sim.time() + 0.1, t1));
+	// 	const double *z = sim.state();
+	// 	cout << sim.time() << ", " << z[0] << endl;
+	// }
+
+	// Run summary (build with "make PROFILE=1", otherwise all zero):
+	// RunSummary summary = simulate(dynFun, t0, t1, z0, z1, nDim, nStep, method);
+	// cout << summary.nEval << " evaluations, " << summary.timeDynamics << " s in the dynamics" << endl;
+
+	// Events: stop the first time the pendulum swings down through zero angle:
+	// std::vector<Event> events;
+	// events.push_back(Event([](double t, const double z[]) { return z[0]; }, EventTerminate, -1));
+	// BinarySink logFile("logFile.traj", method);
+	// EventResult result = simulate(dynFun, t0, t1, z0, z1, nDim, nStep, method, events, logFile);
+
+	// Restartable run: checkpoint to run.ckpt every 5 s; after a crash the same call resumes there:
+	// Checkpoint checkpoint("run.ckpt", 5.0);
+	// BinarySink logFile("logFile.traj", method, SinkAppend);   // continues the dead run's file
+	// simulate(dynFun, t0, t1, z0, z1, nDim, nStep, method, logFile, checkpoint);
+
+	// Multirate: the velocity (component 1) sub-cycles 10 times per macro step dt of the
+	// angle (component 0). Each function computes only its own group's derivatives, which is
+	// where the savings come from:
+	// auto slowFun = [](double t, double z[], double dz[]) { dz[0] = z[1]; };
+	// auto fastFun = [](double t, double z[], double dz[]) { dz[1] = -0.1 * z[1] - sin(z[0]); };
+	// MultirateSplit split;
+	// split.fast = {1};
+	// simulateMultirate(fastFun, slowFun, split, t0, t1, z0, z1, nDim, nStep, 10, RK_DP5);
+
 }
 
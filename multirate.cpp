@@ -0,0 +1,3 @@
+#include "multirate.h"
+
+template class MultirateStepper<DynFun, DynFun>;
@@ -0,0 +1,408 @@
+#ifndef __MULTIRATE_H__
+#define __MULTIRATE_H__
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "integrator.h"
+#include "sink.h"
+#include "stepper.h"
+#include "trajectory.h"
+
+/* Multirate integration, for systems in which a few components change much
+ * faster than the rest. The state indices are split into a fast group and
+ * a slow group, each with its own dynamics function:
+ *
+ *     fastFun(t, z, dz)   fills dz[i] for the fast components i
+ *     slowFun(t, z, dz)   fills dz[i] for the slow components i
+ *
+ * Both read the whole state z; what they write into the other group's
+ * entries of dz is ignored. The slow group takes macro steps H with the
+ * chosen explicit method, and the fast group takes nSub steps of H/nSub,
+ * with the same method, inside each one:
+ *
+ *     MultirateSplit split;
+ *     split.fast = {2, 3, 4};     // the rest is slow
+ *     simulateMultirate(fastFun, slowFun, split, t0, t1, z0, z1, nDim,
+ *                       nStep, nSub, RK_DP5, sink);
+ *
+ * slowFun is called once per stage of each macro step, and fastFun twice
+ * per stage of each sub-step (see below), so with nSub near the ratio of
+ * the two time scales the slow part costs about nSub times less than in
+ * simulate at the fast step. That saving needs fastFun to evaluate only the
+ * fast rates: the whole right-hand side passed as fastFun costs about twice
+ * a single-rate run at the fast step.
+ *
+ * Each macro step goes fastest first:
+ *  1. The fast group sub-cycles from tLow to tUpp. Where fastFun reads the
+ *     slow components, they are extrapolated: the cubic Hermite polynomial
+ *     through the slow states and derivatives at the start and end of the
+ *     last macro step.
+ *  2. The slow group takes its macro step. Where slowFun reads the fast
+ *     components at a stage time, they are interpolated (cubic Hermite)
+ *     between the two sub-steps around it.
+ *  3. The fast group sub-cycles again from tLow, now with the slow group
+ *     interpolated over the step (the Hermite polynomial through its states
+ *     and derivatives at tLow and tUpp). This second pass is the one kept.
+ * The slow group the fast one sees is then continuous, with a continuous
+ * derivative, from one macro step to the next. An extrapolation alone
+ * would jump at every tLow, and each jump would set a weakly damped fast
+ * oscillator ringing.
+ *
+ * The slow derivative at tUpp is the last stage of the slow step for the
+ * FSAL method RK_DP5 and one more slowFun call for the others; the next
+ * step starts from it. The first macro step has no history: it
+ * extrapolates linearly in pass 1 and takes step 2 again after pass 3.
+ *
+ * The coupling in both directions is then accurate to 4th order in H, so
+ * the methods of order 4 and above converge at 4th order. The slow
+ * components must be smooth on the scale of H: slowFun sees the fast
+ * components only at its stage times, so a slow part driven by the fast
+ * oscillation itself (rather than by a slowly varying quantity) needs H
+ * short enough to resolve it. The same holds for a fast transient at t0,
+ * when the fast group starts away from where the slow one holds it. The
+ * coupling also bounds H for stability: keep H times the rate at which the
+ * groups drive each other well below 1.
+ *
+ * Before every fastFun call the slow components it reads are filled in
+ * from the Hermite polynomial. With a large slow group, list them in
+ * split.coupled, or each fast call costs O(nSlow) more.
+ *
+ * The methods are the explicit ones that keep f(tLow, zLow) in the
+ * workspace's first stage: Euler, MidPoint, RungeKutta and RK_2 ... RK_DP5
+ * (see hasMultirateVersion). */
+
+/* The partition of the state */
+struct MultirateSplit {
+	std::vector<int> fast;      // the fast components; all others are slow
+	std::vector<int> coupled;   // the slow components fastFun reads (empty: all)
+};
+
+/* Evaluation counts of a multirate run */
+struct MultirateStats {
+	long long nMacroStep;
+	long long nFastEval;      // fastFun calls
+	long long nSlowEval;      // slowFun calls
+};
+
+/* True for the methods that can drive a multirate run */
+inline bool hasMultirateVersion(IntegrationMethod method) {
+	return !isSymplectic(method) && !isImplicit(method) && !isLowStorage(method);
+}
+
+/* Cubic Hermite weights (h00, h10, h01, h11) at s = (t - tA) / (tB - tA).
+ * s > 1 extrapolates beyond tB. */
+inline void hermiteWeights(double s, double w[4]) {
+	w[0] = (1.0 + 2.0 * s) * (1.0 - s) * (1.0 - s);
+	w[1] = s * (1.0 - s) * (1.0 - s);
+	w[2] = s * s * (3.0 - 2.0 * s);
+	w[3] = s * s * (s - 1.0);
+}
+
+/* Takes multirate macro steps (see above). Keeps the slow history of the
+ * last step, so consecutive steps should continue from where the last one
+ * ended; a step from anywhere else starts afresh. */
+template <class Fast, class Slow>
+class MultirateStepper {
+public:
+	MultirateStepper(Fast fastFun, Slow slowFun, const MultirateSplit& split, int nDim, int nSub,
+	                 IntegrationMethod method) :
+		fastFun(fastFun), slowFun(slowFun), method(method), nDim(nDim), nSub(nSub),
+		nFast((int) split.fast.size()), nSlow(nDim - (int) split.fast.size()),
+		fastIndex(split.fast), zFull(nDim), dzFull(nDim), zsLow(nSlow), zsUpp(nSlow),
+		fsLow(nSlow), fsUpp(nSlow), zsPrev(nSlow), fsPrev(nSlow), zsLine(nSlow),
+		zfGrid((size_t) (nSub + 1) * nFast), ffGrid((size_t) (nSub + 1) * nFast),
+		fastWork(nFast, methodWorkspaceStages(method)),
+		slowWork(nSlow, methodWorkspaceStages(method)),
+		haveHistory(false), haveLast(false), tLast(0.0), zLast(nDim)
+	{
+		if (!hasMultirateVersion(method)) {
+			throw std::invalid_argument("MultirateStepper: method must be explicit, with its first stage at tLow");
+		}
+		if (nSub < 1) {
+			throw std::invalid_argument("MultirateStepper: nSub must be at least 1");
+		}
+		std::vector<bool> isFast(nDim, false);
+		for (int i : fastIndex) {
+			if (i < 0 || i >= nDim || isFast[i]) {
+				throw std::invalid_argument("MultirateStepper: fast indices must be distinct and in [0, nDim)");
+			}
+			isFast[i] = true;
+		}
+		std::vector<int> slowPos(nDim, -1);
+		for (int i = 0; i < nDim; i++) {
+			if (!isFast[i]) {
+				slowPos[i] = (int) slowIndex.size();
+				slowIndex.push_back(i);
+			}
+		}
+		for (int i : split.coupled) {
+			if (i < 0 || i >= nDim || slowPos[i] < 0) {
+				throw std::invalid_argument("MultirateStepper: coupled indices must be slow components");
+			}
+			coupled.push_back(slowPos[i]);
+		}
+		if (split.coupled.empty()) {
+			for (int j = 0; j < nSlow; j++) {
+				coupled.push_back(j);
+			}
+		}
+		stats = MultirateStats{0, 0, 0};
+	}
+
+	/* One macro step from (tLow, zLow) to (tUpp, zUpp) */
+	void step(double tLow, double tUpp, const double zLow[], double zUpp[]) {
+		bool continues = haveLast && tLow == tLast && std::equal(zLow, zLow + nDim, zLast.begin());
+		haveHistory = haveHistory && continues;
+		tStep = tLow;
+		tEnd = tUpp;
+		hSub = (tUpp - tLow) / nSub;
+		gather(zLow, slowIndex, zsLow.data());
+		gather(zLow, fastIndex, zfGrid.data());
+		auto slowSystem = [this](double t, double zs[], double dzs[]) {
+			fastAt(t);
+			scatter(zs, slowIndex, zFull.data());
+			callSlow(t, dzs);
+		};
+
+		/// Slow derivative at tLow (the one the last step ended on), and
+		/// the slow group extrapolated for the first pass of the fast one:
+		if (haveHistory) {
+			fsLow.swap(fsUpp);
+			setSlowModel(tPrev, tLow, zsPrev.data(), fsPrev.data(), zsLow.data(), fsLow.data());
+		} else {
+			std::copy(zLow, zLow + nDim, zFull.begin());
+			callSlow(tLow, fsLow.data());
+			for (int j = 0; j < nSlow; j++) {
+				zsLine[j] = zsLow[j] + (tUpp - tLow) * fsLow[j];
+			}
+			setSlowModel(tLow, tUpp, zsLow.data(), fsLow.data(), zsLine.data(), fsLow.data());
+		}
+		subCycle();
+
+		/// Macro step of the slow group, with the fast one interpolated:
+		seedSlowStage();
+		methodStep(slowSystem, method, tLow, tUpp, zsLow.data(), zsUpp.data(), nSlow, slowWork);
+		slowRateAtEnd();
+
+		/// Sub-cycle the fast group again, with the slow one interpolated
+		/// over the step (and, the first time, retake the slow step):
+		setSlowModel(tLow, tUpp, zsLow.data(), fsLow.data(), zsUpp.data(), fsUpp.data());
+		subCycle();
+		if (!haveHistory) {
+			seedSlowStage();
+			methodStep(slowSystem, method, tLow, tUpp, zsLow.data(), zsUpp.data(), nSlow, slowWork);
+			slowRateAtEnd();
+		}
+
+		/// Keep the history for the next step:
+		tPrev = tLow;
+		zsPrev.swap(zsLow);
+		fsPrev.swap(fsLow);
+		haveHistory = true;
+		scatter(zsUpp.data(), slowIndex, zUpp);
+		scatter(fastState(nSub), fastIndex, zUpp);
+		std::copy(zUpp, zUpp + nDim, zLast.begin());
+		tLast = tUpp;
+		haveLast = true;
+		stats.nMacroStep++;
+	}
+
+	const MultirateStats& counts() const { return stats; }
+
+private:
+	MultirateStepper(const MultirateStepper&);
+	MultirateStepper& operator=(const MultirateStepper&);
+
+	static void gather(const double z[], const std::vector<int>& index, double out[]) {
+		for (size_t j = 0; j < index.size(); j++) {
+			out[j] = z[index[j]];
+		}
+	}
+
+	static void scatter(const double in[], const std::vector<int>& index, double z[]) {
+		for (size_t j = 0; j < index.size(); j++) {
+			z[index[j]] = in[j];
+		}
+	}
+
+	double* fastState(int k) { return &zfGrid[(size_t) k * nFast]; }
+	double* fastRate(int k) { return &ffGrid[(size_t) k * nFast]; }
+
+	void callFast(double t, double dzf[]) {
+		fastFun(t, zFull.data(), dzFull.data());
+		gather(dzFull.data(), fastIndex, dzf);
+		stats.nFastEval++;
+	}
+
+	void callSlow(double t, double dzs[]) {
+		slowFun(t, zFull.data(), dzFull.data());
+		gather(dzFull.data(), slowIndex, dzs);
+		stats.nSlowEval++;
+	}
+
+	void setSlowModel(double tA, double tB, const double zA[], const double fA[],
+	                  const double zB[], const double fB[]) {
+		slowModel = SlowModel{tA, tB, zA, fA, zB, fB};
+	}
+
+	/* Fills the coupled slow components of zFull from the slow model at
+	 * time t */
+	void slowAt(double t) {
+		const SlowModel& m = slowModel;
+		double dt = m.tB - m.tA;
+		double w[4];
+		hermiteWeights((t - m.tA) / dt, w);
+		for (int j : coupled) {
+			zFull[slowIndex[j]] = w[0] * m.zA[j] + w[2] * m.zB[j] + dt * (w[1] * m.fA[j] + w[3] * m.fB[j]);
+		}
+	}
+
+	/* Fills the fast components of zFull from the sub-steps around time t */
+	void fastAt(double t) {
+		int k = (int) std::floor((t - tStep) / hSub);
+		k = std::min(std::max(k, 0), nSub - 1);
+		double tA = tStep + k * hSub;
+		double tB = (k == nSub - 1) ? tEnd : tA + hSub;
+		double dt = tB - tA;
+		double w[4];
+		hermiteWeights((t - tA) / dt, w);
+		const double *zA = fastState(k), *fA = fastRate(k);
+		const double *zB = fastState(k + 1), *fB = fastRate(k + 1);
+		for (int j = 0; j < nFast; j++) {
+			zFull[fastIndex[j]] = w[0] * zA[j] + w[2] * zB[j] + dt * (w[1] * fA[j] + w[3] * fB[j]);
+		}
+	}
+
+	/* Hands fsLow to the slow step as its first stage. Only an FSAL method
+	 * picks it up; the others evaluate their first stage themselves. */
+	void seedSlowStage() {
+		int iLast = methodStageCount(method) - 1;
+		std::copy(zsLow.begin(), zsLow.end(), slowWork.z(iLast));
+		std::copy(fsLow.begin(), fsLow.end(), slowWork.f(iLast));
+		slowWork.setLastStage(tStep, iLast);
+	}
+
+	/* Slow derivative at tEnd, from the slow step just taken: its last
+	 * stage for an FSAL method, else one more call */
+	void slowRateAtEnd() {
+		int iLast = slowWork.lastStageIndex();
+		if (iLast >= 0 && slowWork.lastStageTime() == tEnd
+		    && std::equal(zsUpp.begin(), zsUpp.end(), slowWork.z(iLast))) {
+			std::copy(slowWork.f(iLast), slowWork.f(iLast) + nSlow, fsUpp.begin());
+			return;
+		}
+		scatter(zsUpp.data(), slowIndex, zFull.data());
+		scatter(fastState(nSub), fastIndex, zFull.data());
+		callSlow(tEnd, fsUpp.data());
+	}
+
+	/* nSub steps of the fast group from tStep to tEnd, keeping the state
+	 * and derivative at every sub-step boundary */
+	void subCycle() {
+		auto fastSystem = [this](double t, double zf[], double dzf[]) {
+			slowAt(t);
+			scatter(zf, fastIndex, zFull.data());
+			callFast(t, dzf);
+		};
+		fastWork.clearLastStage();   // the slow model has changed
+		double tLow = tStep;
+		for (int k = 0; k < nSub; k++) {
+			double tUpp = (k == nSub - 1) ? tEnd : tStep + (k + 1) * hSub;
+			methodStep(fastSystem, method, tLow, tUpp, fastState(k), fastState(k + 1), nFast, fastWork);
+			std::copy(fastWork.f(0), fastWork.f(0) + nFast, fastRate(k));
+			tLow = tUpp;
+		}
+
+		/// Derivative at tEnd (the last stage of the last sub-step, if FSAL):
+		const double *zEnd = fastState(nSub);
+		int iLast = fastWork.lastStageIndex();
+		if (iLast >= 0 && fastWork.lastStageTime() == tEnd
+		    && std::equal(zEnd, zEnd + nFast, fastWork.z(iLast))) {
+			std::copy(fastWork.f(iLast), fastWork.f(iLast) + nFast, fastRate(nSub));
+		} else {
+			fastSystem(tEnd, fastState(nSub), fastRate(nSub));
+		}
+	}
+
+	/* Cubic Hermite polynomial of the slow group, through (tA, zA, fA) and
+	 * (tB, zB, fB) */
+	struct SlowModel {
+		double tA, tB;
+		const double *zA, *fA, *zB, *fB;
+	};
+
+	Fast fastFun;
+	Slow slowFun;
+	IntegrationMethod method;
+	int nDim, nSub, nFast, nSlow;
+	std::vector<int> fastIndex, slowIndex;
+	std::vector<int> coupled;            // positions in the slow group
+	std::vector<double> zFull, dzFull;   // nDim: the state the dynamics functions see
+
+	/// Slow group: this step, the last one, and the line of a first step
+	std::vector<double> zsLow, zsUpp, fsLow, fsUpp;
+	std::vector<double> zsPrev, fsPrev, zsLine;
+	double tPrev;
+	SlowModel slowModel;
+
+	/// Fast group at the nSub + 1 sub-step boundaries of this step
+	std::vector<double> zfGrid, ffGrid;
+	double tStep, tEnd, hSub;
+
+	StepperWorkspace fastWork, slowWork;
+	bool haveHistory;             // zsPrev, fsPrev hold the last step
+	bool haveLast;                // the last step ended at (tLast, zLast)
+	double tLast;
+	std::vector<double> zLast;
+	MultirateStats stats;
+};
+
+/* Runs nStep multirate macro steps from t0 to t1, each with nSub fast
+ * sub-steps (see above), passing the full state after every macro step to
+ * the sink and returning the final state in z1. */
+template <class Fast, class Slow>
+MultirateStats simulateMultirate(Fast fastFun, Slow slowFun, const MultirateSplit& split,
+                                 double t0, double t1, double z0[], double z1[], int nDim,
+                                 int nStep, int nSub, IntegrationMethod method, TrajectorySink& sink)
+{
+	MultirateStepper<Fast, Slow> stepper(fastFun, slowFun, split, nDim, nSub, method);
+
+	/// Allocate memory:
+	std::vector<double> zLow(z0, z0 + nDim), zUpp(nDim);
+
+	/// March forward in time:
+	sink.record(t0, z0, nDim);
+	double dt = (t1 - t0) / ((double) nStep);
+	double tLow = t0;
+	for (int i = 0; i < nStep; i++) {
+		double tUpp = (i == nStep - 1) ? t1 : tLow + dt;
+		stepper.step(tLow, tUpp, zLow.data(), zUpp.data());
+		sink.record(tUpp, zUpp.data(), nDim);
+		tLow = tUpp;
+		zLow.swap(zUpp);
+	}
+	sink.flush();
+	std::copy(zLow.begin(), zLow.end(), z1);
+	return stepper.counts();
+}
+
+/* simulateMultirate, writing the trajectory to the binary file
+ * "logFile.traj" from a background thread */
+template <class Fast, class Slow>
+MultirateStats simulateMultirate(Fast fastFun, Slow slowFun, const MultirateSplit& split,
+                                 double t0, double t1, double z0[], double z1[], int nDim,
+                                 int nStep, int nSub, IntegrationMethod method)
+{
+	AsyncSink logFile(std::unique_ptr<TrajectorySink>(new BinarySink("logFile.traj", method)));
+	return simulateMultirate(fastFun, slowFun, split, t0, t1, z0, z1, nDim, nStep, nSub,
+	                         method, logFile);
+}
+
+/* Compiled once, in multirate.cpp, for plain function pointers */
+extern template class MultirateStepper<DynFun, DynFun>;
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef __PRECISION_H__
+#define __PRECISION_H__
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "stepper.h"
+#include "tableau.h"
+#include "RK_2.h"
+#include "RK_4A.h"
+#include "RK_4B.h"
+#include "RK_45.h"
+#include "RK_5.h"
+#include "RK_10.h"
+#include "RK_DP5.h"
+
+/* The Butcher-tableau methods (RK_2 ... RK_DP5) in any scalar type, for
+ * fixed steps:
+ *
+ *     simulateScalar<float>(dynFun, 0.0f, 1.0f, z0, z1, nDim, nStep, RK_45);
+ *     simulateScalar<long double>(dynFun, 0.0L, 1.0L, z0, z1, nDim, nStep, RK_10);
+ *     simulateScalar<float, double>(dynFun, 0.0, 1.0, z0, z1, nDim, nStep, RK_DP5);
+ *
+ * simulateScalar<Real, Acc> keeps the solution (z0, z1 and the step
+ * updates) in Acc and the stages in Real: the stage states are rounded to
+ * Real, the dynamics work in Real, and the stage derivatives are summed
+ * into the solution in Acc. Acc = Real (the default) is a plain run in that
+ * type; a wider Acc keeps the rounding error of the accumulated solution
+ * from growing with the number of steps, while the dynamics and stage
+ * buffers run at the speed and memory traffic of the narrower type. The
+ * dynamics take dynFun(Acc t, Real z[], Real dz[]), so the stage times keep
+ * the solution's precision.
+ *
+ * The coefficients come from each tableau's XX__Coefficients template,
+ * instantiated for Acc. Its literals are long double, so a long double run
+ * of RK_10 gets its coefficients to 64 bits, not 53. Wider types
+ * (__float128) work, with coefficients of long double accuracy. */
+
+/* Stage buffers of type Real. A fixed-step run allocates one. */
+template <class Real>
+class ScalarWorkspace {
+public:
+	ScalarWorkspace(int nDim, int nStage) :
+		lastStage(-1), lastTime(0.0), dim(nDim), zBuf((size_t) nDim * nStage),
+		fBuf((size_t) nDim * nStage) {}
+
+	int nDim() const { return dim; }
+	Real* z(int iStage) { return &zBuf[(size_t) iStage * dim]; }
+	Real* f(int iStage) { return &fBuf[(size_t) iStage * dim]; }
+
+	/* First-same-as-last record, as in StepperWorkspace */
+	int lastStage;          // -1: none
+	long double lastTime;
+
+private:
+	int dim;
+	std::vector<Real> zBuf;
+	std::vector<Real> fBuf;
+};
+
+/* One step of the tableau Coefficients, with stages in Real and the
+ * solution in Acc. Arguments match RK_STEP. */
+template <template <class> class Coefficients, class Real, class Acc, class Dyn>
+void RK_STEP_SCALAR(Dyn& dynFun, Acc tLow, Acc tUpp, const Acc zLow[], Acc zUpp[], int nDim,
+                    ScalarWorkspace<Real>& work)
+{
+	typedef Coefficients<Acc> T;
+	const int nStage = T::nStage;
+	constexpr bool fsal = tableauIsFsal<Coefficients<double> >();
+	Acc dt = tUpp - tLow;
+
+	/// Dynamics at initial point (unless the last step left it behind):
+	bool reused = false;
+	if (fsal && work.lastStage >= 0 && (long double) tLow == work.lastTime) {
+		const Real *zLast = work.z(work.lastStage);
+		reused = true;
+		for (int i = 0; i < nDim && reused; i++) {
+			reused = (Real) zLow[i] == zLast[i];
+		}
+		if (reused) {
+			std::copy(work.f(work.lastStage), work.f(work.lastStage) + nDim, work.f(0));
+		}
+	}
+	if (!reused) {
+		Real *z0 = work.z(0);
+		for (int i = 0; i < nDim; i++) {
+			z0[i] = (Real) zLow[i];
+		}
+		dynFun(tLow + dt * T::A[0], z0, work.f(0));
+	}
+
+	/// March through each stage, summing in Acc:
+	for (int iStage = 1; iStage < nStage; iStage++) {
+		const Acc *b = &T::B[iStage * (iStage - 1) / 2];
+		Real *z = work.z(iStage);
+		for (int iDim = 0; iDim < nDim; iDim++) {
+			Acc sum = 0;
+			for (int j = 0; j < iStage; j++) {
+				sum += b[j] * (Acc) work.f(j)[iDim];
+			}
+			z[iDim] = (Real) (zLow[iDim] + dt * sum);
+		}
+		dynFun(tLow + dt * T::A[iStage], z, work.f(iStage));
+	}
+
+	/// Compute the final estimate:
+	for (int iDim = 0; iDim < nDim; iDim++) {
+		Acc sum = 0;
+		for (int j = 0; j < nStage; j++) {
+			sum += T::C[j] * (Acc) work.f(j)[iDim];
+		}
+		zUpp[iDim] = zLow[iDim] + dt * sum;
+	}
+	work.lastStage = fsal ? nStage - 1 : -1;
+	work.lastTime = (long double) tUpp;
+}
+
+/* True for the methods simulateScalar can run */
+inline bool hasScalarVersion(IntegrationMethod method) {
+	switch (method) {
+	case RK_2: case RK_4A: case RK_4B: case RK_45: case RK_5: case RK_10: case RK_DP5:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* One step of any method with a scalar version */
+template <class Real, class Acc, class Dyn>
+void scalarStep(Dyn& dynFun, IntegrationMethod method, Acc tLow, Acc tUpp, const Acc zLow[],
+                Acc zUpp[], int nDim, ScalarWorkspace<Real>& work)
+{
+	switch (method) {
+	case RK_2:
+		RK_STEP_SCALAR<RK2__Coefficients>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case RK_4A:
+		RK_STEP_SCALAR<RK4A__Coefficients>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case RK_4B:
+		RK_STEP_SCALAR<RK4B__Coefficients>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case RK_45:
+		RK_STEP_SCALAR<RK45__Coefficients>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case RK_5:
+		RK_STEP_SCALAR<RK5__Coefficients>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case RK_10:
+		RK_STEP_SCALAR<RK10__Coefficients>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	case RK_DP5:
+		RK_STEP_SCALAR<DP5__Coefficients>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work); break;
+	default:
+		throw std::invalid_argument("scalarStep: method has no scalar-generic version");
+	}
+}
+
+/* Runs nStep fixed steps from t0 to t1, with the stages in Real and the
+ * solution in Acc (see above). Nothing is logged; the final state is
+ * returned in z1. */
+template <class Real, class Acc = Real, class Dyn>
+void simulateScalar(Dyn dynFun, Acc t0, Acc t1, const Acc z0[], Acc z1[], int nDim, int nStep,
+                    IntegrationMethod method)
+{
+	if (!hasScalarVersion(method)) {
+		throw std::invalid_argument("simulateScalar: method has no scalar-generic version");
+	}
+
+	/// Allocate memory:
+	std::vector<Acc> zLow(z0, z0 + nDim), zUpp(nDim);
+	ScalarWorkspace<Real> work(nDim, methodStageCount(method));
+
+	/// March forward in time:
+	Acc dt = (t1 - t0) / (Acc) nStep;
+	Acc tLow = t0;
+	for (int i = 0; i < nStep; i++) {
+		Acc tUpp = (i == nStep - 1) ? t1 : tLow + dt;
+		scalarStep(dynFun, method, tLow, tUpp, zLow.data(), zUpp.data(), nDim, work);
+		tLow = tUpp;
+		zLow.swap(zUpp);
+	}
+	std::copy(zLow.begin(), zLow.end(), z1);
+}
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "sink.h"
+
+/* Optional instrumentation of the simulation drivers. Built with
+ *     make PROFILE=1          (which adds -DRK_INSTRUMENT)
+ * simulate and simulateAdaptive count the dynamics calls, steps and logged
+ * bytes of each run and time its phases, and hand back a RunSummary.
+ * Without the flag every hook below is empty and the compiler removes it:
+ * the drivers run exactly the code they would without this file, and the
+ * summaries they return are all zero. */
+
+#ifdef RK_INSTRUMENT
+const bool INSTRUMENTED = true;
+#else
+const bool INSTRUMENTED = false;
+#endif
+
+/* What one run did, and where its time went */
+struct RunSummary {
+	long long nEval;          // calls to the dynamics function (steps, dense output, events)
+	long long nAccept;        // steps kept (every step of a fixed-step run)
+	long long nReject;        // adaptive steps that were repeated
+	long long bytesLogged;    // (t, z) data passed to the sink
+	double timeDynamics;      // seconds inside the dynamics function
+	double timeStages;        // seconds in the step functions, outside the dynamics
+	double timeAlloc;         // seconds allocating and freeing the step buffers
+	double timeLogging;       // seconds in the sink (record and flush)
+	double timeTotal;         // seconds for the whole run
+
+	RunSummary() :
+		nEval(0), nAccept(0), nReject(0), bytesLogged(0), timeDynamics(0.0),
+		timeStages(0.0), timeAlloc(0.0), timeLogging(0.0), timeTotal(0.0) {}
+};
+
+enum ProfilePhase { PhaseDynamics, PhaseStages, PhaseAlloc, PhaseLogging, nProfilePhase };
+
+/* Cheap timestamp: the time-stamp counter on x86 (a few ns to read),
+ * the steady clock elsewhere. Only differences are meaningful. */
+inline unsigned long long profileTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+/* Collects the RunSummary of one run. The phases are timed in ticks; finish()
+ * converts them to seconds with the tick rate measured over the run itself,
+ * so no calibration is needed up front. */
+class RunProfiler {
+public:
+	RunProfiler();
+	RunSummary finish();
+
+	RunSummary summary;                         // counters
+	unsigned long long ticks[nProfilePhase];    // time per phase
+
+private:
+	unsigned long long tickStart;
+	std::chrono::steady_clock::time_point clockStart;
+};
+
+/* Adds the time from construction to destruction to one phase */
+class PhaseTimer {
+public:
+#ifdef RK_INSTRUMENT
+	PhaseTimer(RunProfiler& profiler, ProfilePhase phase) :
+		profiler(profiler), phase(phase), start(profileTicks()) {}
+	~PhaseTimer() { profiler.ticks[phase] += profileTicks() - start; }
+
+private:
+	RunProfiler& profiler;
+	ProfilePhase phase;
+	unsigned long long start;
+#else
+	PhaseTimer(RunProfiler&, ProfilePhase) {}
+#endif
+};
+
+/* Times one step: the part not spent in the dynamics goes to PhaseStages */
+class StepTimer {
+public:
+#ifdef RK_INSTRUMENT
+	explicit StepTimer(RunProfiler& profiler) :
+		profiler(profiler), dynStart(profiler.ticks[PhaseDynamics]), start(profileTicks()) {}
+	~StepTimer() {
+		unsigned long long inDynamics = profiler.ticks[PhaseDynamics] - dynStart;
+		profiler.ticks[PhaseStages] += profileTicks() - start - inDynamics;
+	}
+
+private:
+	RunProfiler& profiler;
+	unsigned long long dynStart;
+	unsigned long long start;
+#else
+	explicit StepTimer(RunProfiler&) {}
+#endif
+};
+
+/* A dynamics function that counts and times its calls */
+template <class Dyn>
+struct ProfiledDynamics {
+	Dyn& dynFun;
+	RunProfiler& profiler;
+
+	void operator()(double t, double z[], double dz[]) {
+		PhaseTimer timer(profiler, PhaseDynamics);
+		profiler.summary.nEval++;
+		dynFun(t, z, dz);
+	}
+};
+
+/* A sink that counts and times what is passed on to another */
+class ProfiledSink : public TrajectorySink {
+public:
+	ProfiledSink(TrajectorySink& target, RunProfiler& profiler) :
+		target(target), profiler(profiler) {}
+
+	void record(double t, const double z[], int nDim) {
+		PhaseTimer timer(profiler, PhaseLogging);
+		profiler.summary.bytesLogged += (1 + nDim) * (long long) sizeof(double);
+		target.record(t, z, nDim);
+	}
+
+	void flush() {
+		PhaseTimer timer(profiler, PhaseLogging);
+		target.flush();
+	}
+
+	void resume(double t) {
+		PhaseTimer timer(profiler, PhaseLogging);
+		target.resume(t);
+	}
+
+private:
+	TrajectorySink& target;
+	RunProfiler& profiler;
+};
+
+/* What the drivers integrate and log through: the instrumented wrappers,
+ * or (without RK_INSTRUMENT) the dynamics function and sink themselves.
+ * Bind the results with auto&&. */
+#ifdef RK_INSTRUMENT
+template <class Dyn>
+ProfiledDynamics<Dyn> profiledDynamics(Dyn& dynFun, RunProfiler& profiler) {
+	return ProfiledDynamics<Dyn>{dynFun, profiler};
+}
+inline ProfiledSink profiledSink(TrajectorySink& sink, RunProfiler& profiler) {
+	return ProfiledSink(sink, profiler);
+}
+#else
+template <class Dyn>
+Dyn& profiledDynamics(Dyn& dynFun, RunProfiler&) {
+	return dynFun;
+}
+inline TrajectorySink& profiledSink(TrajectorySink& sink, RunProfiler&) {
+	return sink;
+}
+#endif
+
+/* A dynamics function that counts its calls, built with or without
+ * RK_INSTRUMENT: the nEval of simulateAdaptive and Simulation. Every call
+ * is counted, also the Newton iterations of the implicit methods and the
+ * drifts and kicks of the symplectic ones. */
+template <class Dyn>
+struct CountedDynamics {
+	Dyn& dynFun;
+	int& nEval;
+
+	void operator()(double t, double z[], double dz[]) {
+		nEval++;
+		dynFun(t, z, dz);
+	}
+};
+
+template <class Dyn>
+CountedDynamics<Dyn> countedDynamics(Dyn& dynFun, int& nEval) {
+	return CountedDynamics<Dyn>{dynFun, nEval};
+}
+
+#endif
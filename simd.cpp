@@ -0,0 +1,173 @@
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86
+#endif
+
+/* Largest number of terms passed to a kernel at once. Longer sums are split
+ * into several passes (RK10, the longest built-in table, has 17 stages). */
+static const int MAX_TERM = 32;
+
+typedef void (*CombineKernel)(double[], const double[], double,
+                              const double[], const double* const[], int, int);
+
+
+/******************************************************************************
+ *                              Kernels                                       *
+ ******************************************************************************/
+
+/* Plain C++ version, for elements iBegin ... iEnd-1. Also used for the
+ * leftover tail of the vector kernels. */
+static inline void combineRange(double out[], const double base[], double dt,
+                                const double w[], const double* const f[], int nTerm,
+                                int iBegin, int iEnd)
+{
+	for (int i = iBegin; i < iEnd; i++) {
+		double sum = 0.0;
+		for (int j = 0; j < nTerm; j++) {
+			sum = sum + w[j] * f[j][i];
+		}
+		out[i] = (base ? base[i] : 0.0) + dt * sum;
+	}
+}
+
+static void combineScalar(double out[], const double base[], double dt,
+                          const double w[], const double* const f[], int nTerm, int n)
+{
+	combineRange(out, base, dt, w, f, nTerm, 0, n);
+}
+
+#ifdef SIMD_X86
+
+/* AVX2 + FMA: two 4-wide vectors per iteration, to hide the FMA latency */
+__attribute__((target("avx2,fma")))
+static void combineAVX2(double out[], const double base[], double dt,
+                        const double w[], const double* const f[], int nTerm, int n)
+{
+	__m256d wv[MAX_TERM];
+	for (int j = 0; j < nTerm; j++) {
+		wv[j] = _mm256_set1_pd(w[j]);
+	}
+	__m256d vdt = _mm256_set1_pd(dt);
+
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256d acc0 = _mm256_setzero_pd();
+		__m256d acc1 = _mm256_setzero_pd();
+		for (int j = 0; j < nTerm; j++) {
+			acc0 = _mm256_fmadd_pd(wv[j], _mm256_loadu_pd(f[j] + i), acc0);
+			acc1 = _mm256_fmadd_pd(wv[j], _mm256_loadu_pd(f[j] + i + 4), acc1);
+		}
+		__m256d b0 = base ? _mm256_loadu_pd(base + i) : _mm256_setzero_pd();
+		__m256d b1 = base ? _mm256_loadu_pd(base + i + 4) : _mm256_setzero_pd();
+		_mm256_storeu_pd(out + i, _mm256_fmadd_pd(vdt, acc0, b0));
+		_mm256_storeu_pd(out + i + 4, _mm256_fmadd_pd(vdt, acc1, b1));
+	}
+	combineRange(out, base, dt, w, f, nTerm, i, n);
+}
+
+/* AVX-512F: two 8-wide vectors per iteration */
+__attribute__((target("avx512f")))
+static void combineAVX512(double out[], const double base[], double dt,
+                          const double w[], const double* const f[], int nTerm, int n)
+{
+	__m512d wv[MAX_TERM];
+	for (int j = 0; j < nTerm; j++) {
+		wv[j] = _mm512_set1_pd(w[j]);
+	}
+	__m512d vdt = _mm512_set1_pd(dt);
+
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m512d acc0 = _mm512_setzero_pd();
+		__m512d acc1 = _mm512_setzero_pd();
+		for (int j = 0; j < nTerm; j++) {
+			acc0 = _mm512_fmadd_pd(wv[j], _mm512_loadu_pd(f[j] + i), acc0);
+			acc1 = _mm512_fmadd_pd(wv[j], _mm512_loadu_pd(f[j] + i + 8), acc1);
+		}
+		__m512d b0 = base ? _mm512_loadu_pd(base + i) : _mm512_setzero_pd();
+		__m512d b1 = base ? _mm512_loadu_pd(base + i + 8) : _mm512_setzero_pd();
+		_mm512_storeu_pd(out + i, _mm512_fmadd_pd(vdt, acc0, b0));
+		_mm512_storeu_pd(out + i + 8, _mm512_fmadd_pd(vdt, acc1, b1));
+	}
+	combineRange(out, base, dt, w, f, nTerm, i, n);
+}
+
+#endif
+
+
+/******************************************************************************
+ *                          Run-Time Dispatch                                 *
+ ******************************************************************************/
+
+SimdLevel simdLevelSupported() {
+#ifdef SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		return SimdAVX512;
+	}
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		return SimdAVX2;
+	}
+#endif
+	return SimdScalar;
+}
+
+static SimdLevel& activeLevel() {
+	static SimdLevel level = simdLevelSupported();
+	return level;
+}
+
+SimdLevel simdLevel() {
+	return activeLevel();
+}
+
+void setSimdLevel(SimdLevel level) {
+	SimdLevel supported = simdLevelSupported();
+	activeLevel() = level < supported ? level : supported;
+}
+
+static CombineKernel activeKernel() {
+	switch (activeLevel()) {
+#ifdef SIMD_X86
+	case SimdAVX512: return combineAVX512;
+	case SimdAVX2: return combineAVX2;
+#endif
+	default: return combineScalar;
+	}
+}
+
+void stageCombineRange(double out[], const double base[], double dt,
+                       const double w[], const double* const f[], int nTerm,
+                       int iBegin, int iEnd)
+{
+	CombineKernel kernel = activeKernel();
+	out = out + iBegin;
+	if (base) {
+		base = base + iBegin;
+	}
+
+	/// Drop the zero terms, and pass the rest on in groups of MAX_TERM:
+	double wNonZero[MAX_TERM];
+	const double *fNonZero[MAX_TERM];
+	int j = 0;
+	do {
+		int m = 0;
+		for (; j < nTerm && m < MAX_TERM; j++) {
+			if (w[j] != 0.0) {
+				wNonZero[m] = w[j];
+				fNonZero[m] = f[j] + iBegin;
+				m++;
+			}
+		}
+		kernel(out, base, dt, wNonZero, fNonZero, m, iEnd - iBegin);
+		base = out;   // later groups accumulate onto the result
+	} while (j < nTerm);
+}
+
+void stageCombine(double out[], const double base[], double dt,
+                  const double w[], const double* const f[], int nTerm, int n)
+{
+	stageCombineRange(out, base, dt, w, f, nTerm, 0, n);
+}
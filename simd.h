@@ -0,0 +1,44 @@
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+/* Vectorized stage-combination kernels.
+ *
+ * Every Runge--Kutta stage, and the final solution, is an update of the form
+ *     out[i] = base[i] + dt * (w[0]*f[0][i] + w[1]*f[1][i] + ... )
+ * stageCombine does all of the terms in a single pass over memory, with
+ * AVX-512 or AVX2/FMA code when the CPU has it and plain C++ otherwise.
+ * The instruction set is picked at run time, once, on the first call.
+ */
+
+/* State dimension above which the step functions hand their stage updates
+ * to stageCombine. Below it the per-call overhead is not worth it. */
+const int SIMD_MIN_DIM = 64;
+
+enum SimdLevel {
+	SimdScalar,
+	SimdAVX2,     // AVX2 + FMA, 4 doubles per instruction
+	SimdAVX512    // AVX-512F, 8 doubles per instruction
+};
+
+/* Instruction set used by stageCombine */
+SimdLevel simdLevel();
+
+/* Best instruction set this CPU supports */
+SimdLevel simdLevelSupported();
+
+/* Caps the instruction set used by stageCombine (e.g. for benchmarking the
+ * scalar fallback). Requests above simdLevelSupported() are lowered to it. */
+void setSimdLevel(SimdLevel level);
+
+/* out[i] = base[i] + dt * sum_j w[j] * f[j][i],   for i = 0 ... n-1
+ * Terms with w[j] == 0 are skipped. base may be null (treated as zero), and
+ * may be the same array as out. */
+void stageCombine(double out[], const double base[], double dt,
+                  const double w[], const double* const f[], int nTerm, int n);
+
+/* stageCombine restricted to i = iBegin ... iEnd-1 (one thread's chunk) */
+void stageCombineRange(double out[], const double base[], double dt,
+                       const double w[], const double* const f[], int nTerm,
+                       int iBegin, int iEnd);
+
+#endif
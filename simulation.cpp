@@ -0,0 +1,3 @@
+#include "simulation.h"
+
+template class Simulation<DynFun>;
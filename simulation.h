@@ -0,0 +1,172 @@
+#ifndef __SIMULATION_H__
+#define __SIMULATION_H__
+
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "integrator.h"
+
+/* A simulation that is advanced step by step by its caller, instead of run
+ * to completion like simulate / simulateAdaptive:
+ *
+ *     Simulation<DynFun> sim(dynFun, t0, z0, nDim, RK_45, 0.01);
+ *     while (sim.time() < t1) {
+ *         sim.advanceTo(sim.time() + 0.1);
+ *         const double *z = sim.state();      // no copy
+ *         ...                                  // react to it, change the inputs
+ *     }
+ *
+ * Steps are fixed (of size dt) or adaptive (the controller of
+ * simulateAdaptive). Nothing is logged unless a sink is attached with
+ * observe(). The state buffers and workspace are allocated once, and
+ * stepping only swaps them (the methods that step in place, see
+ * stepsInPlace, have just one), so state() stays a pointer into the
+ * simulation: it is valid until the next step. */
+template <class Dyn>
+class Simulation {
+public:
+	/* Fixed steps of size dt */
+	Simulation(Dyn dynFun, double t0, const double z0[], int nDim,
+	           IntegrationMethod method, double dt) :
+		dynFun(dynFun), method(method), adaptive(false), inPlace(stepsInPlace(method)), nDim(nDim),
+		tNow(t0), dt(dt), zLow(z0, z0 + nDim), zUpp(inPlace ? 0 : nDim),
+		work(nDim, methodWorkspaceStages(method)),
+		controller(options, std::numeric_limits<double>::infinity()), sink(0)
+	{
+		if (!(dt > 0.0)) {
+			throw std::invalid_argument("Simulation: dt must be positive");
+		}
+	}
+
+	/* Adaptive steps, for methods with an error estimate. The first trial
+	 * step is options.dtInit or, if that is not set, a hundredth of the
+	 * first advanceTo() interval. options.dtMax <= 0 puts no limit on the
+	 * step size. */
+	Simulation(Dyn dynFun, double t0, const double z0[], int nDim,
+	           IntegrationMethod method, const AdaptiveOptions& options) :
+		dynFun(dynFun), method(method), adaptive(true), inPlace(false), nDim(nDim),
+		tNow(t0), dt(options.dtInit), options(options), zLow(z0, z0 + nDim), zUpp(nDim), zErr(nDim),
+		work(nDim, methodWorkspaceStages(method)),
+		controller(options, options.dtMax > 0.0 ? options.dtMax
+		                                         : std::numeric_limits<double>::infinity()),
+		sink(0)
+	{
+		if (!hasErrorEstimate(method)) {
+			throw std::invalid_argument("Simulation: method has no error estimate");
+		}
+		if (options.dtMax > 0.0 && dt > options.dtMax) {
+			dt = options.dtMax;
+		}
+	}
+
+	/* Current time and state. The state is valid until the next step. */
+	double time() const { return tNow; }
+	const double* state() const { return zLow.data(); }
+	int dim() const { return nDim; }
+
+	/* Copies the current state to z */
+	void copyState(double z[]) const { std::copy(zLow.begin(), zLow.end(), z); }
+
+	/* Passes the current state, and every step from now on, to the sink
+	 * (0: stop logging). The caller flushes it. */
+	void observe(TrajectorySink* observer) {
+		sink = observer;
+		if (sink) {
+			sink->record(tNow, zLow.data(), nDim);
+		}
+	}
+
+	/* Takes one step (adaptive: one accepted step) and returns the new time */
+	double step() {
+		if (adaptive && !(dt > 0.0)) {
+			throw std::logic_error("Simulation: set options.dtInit, or call advanceTo first");
+		}
+		stepUntil(std::numeric_limits<double>::infinity());
+		return tNow;
+	}
+
+	/* Steps until time t (>= time()); the last step is cut to end on t */
+	void advanceTo(double t) {
+		if (t < tNow) {
+			throw std::invalid_argument("Simulation: cannot advance backwards in time");
+		}
+		if (adaptive && !(dt > 0.0)) {
+			dt = (t - tNow) / 100.0;
+			if (options.dtMax > 0.0 && dt > options.dtMax) {
+				dt = options.dtMax;
+			}
+		}
+		while (tNow < t) {
+			stepUntil(t);
+		}
+	}
+
+	/* Steps taken so far (nAccept; adaptive: also nReject) and dynamics calls */
+	const AdaptiveStats& stats() const { return counts; }
+
+private:
+	Simulation(const Simulation&);
+	Simulation& operator=(const Simulation&);
+
+	/* One step, not past tEnd */
+	void stepUntil(double tEnd) {
+		auto counted = countedDynamics(dynFun, counts.nEval);
+		if (!adaptive) {
+			double tUpp = tNow + dt;
+			if (tUpp >= tEnd || tEnd - tUpp < 1e-9 * dt) {
+				tUpp = tEnd;   // no sliver step left over from round-off
+			}
+			double *zNew = inPlace ? zLow.data() : zUpp.data();
+			methodStep(counted, method, tNow, tUpp, zLow.data(), zNew, nDim, work);
+			accept(tUpp);
+			return;
+		}
+		for (;;) {
+			double tUpp = tNow + dt >= tEnd ? tEnd : tNow + dt;
+			if (!(tUpp > tNow)) {
+				throw std::runtime_error("Simulation: step size underflow");
+			}
+			int order = embeddedStep(counted, method, tNow, tUpp, zLow.data(), zUpp.data(),
+			                         zErr.data(), nDim, work);
+			double err = errorNorm(zLow.data(), zUpp.data(), zErr.data(), nDim, options);
+			if (controller.judge(err, order, dt)) {
+				accept(tUpp);
+				return;
+			}
+			counts.nReject++;
+		}
+	}
+
+	void accept(double tUpp) {
+		counts.nAccept++;
+		tNow = tUpp;
+		if (!inPlace) {
+			zLow.swap(zUpp);
+		}
+		if (sink) {
+			sink->record(tNow, zLow.data(), nDim);
+		}
+	}
+
+	Dyn dynFun;
+	IntegrationMethod method;
+	bool adaptive;
+	bool inPlace;                 // stepsInPlace: zUpp is not used
+	int nDim;
+	double tNow;
+	double dt;                    // (next trial) step size
+	AdaptiveOptions options;
+	std::vector<double> zLow;     // current state
+	std::vector<double> zUpp;
+	std::vector<double> zErr;
+	StepperWorkspace work;
+	StepSizeController controller;
+	AdaptiveStats counts;
+	TrajectorySink *sink;
+};
+
+/* Compiled once, in simulation.cpp, for plain function pointers */
+extern template class Simulation<DynFun>;
+
+#endif
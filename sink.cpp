@@ -0,0 +1,162 @@
+#include <chrono>
+#include <cstring>
+
+#include "sink.h"
+
+/* Prints the current time and state to the log file */
+void printState(std::ofstream& file, double t, const double z[], int nDim) {
+	file << t ;
+	for (int j = 0; j < nDim; j++) {
+		file << ", " << z[j];
+	}
+	file << "\n";
+}
+
+
+/******************************************************************************
+ *                               CsvSink                                      *
+ ******************************************************************************/
+CsvSink::CsvSink(const std::string& fileName, int precision) :
+	buffer(1 << 20)
+{
+	file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+	file.open(fileName.c_str());
+	file.precision(precision);
+}
+
+void CsvSink::record(double t, const double z[], int nDim) {
+	printState(file, t, z, nDim);
+}
+
+void CsvSink::flush() {
+	file.flush();
+}
+
+
+/******************************************************************************
+ *                            DecimatedSink                                   *
+ ******************************************************************************/
+
+DecimatedSink::DecimatedSink(TrajectorySink& target, int every) :
+	target(target), every(every), count(0), lastKept(true), tLast(0.0)
+{
+}
+
+void DecimatedSink::record(double t, const double z[], int nDim) {
+	if (every <= 0) {
+		return;
+	}
+	lastKept = (count % every == 0);
+	count++;
+	if (lastKept) {
+		target.record(t, z, nDim);
+	} else {
+		tLast = t;
+		zLast.assign(z, z + nDim);
+	}
+}
+
+void DecimatedSink::flush() {
+	if (!lastKept) {
+		target.record(tLast, zLast.data(), (int) zLast.size());
+		lastKept = true;
+	}
+	target.flush();
+}
+
+
+/******************************************************************************
+ *                              AsyncSink                                     *
+ ******************************************************************************/
+
+/* Records the writer takes at a time before it wakes up the producer */
+static const int ASYNC_BATCH = 256;
+
+AsyncSink::AsyncSink(std::unique_ptr<TrajectorySink> target, int capacity) :
+	target(std::move(target)), capacity(capacity > 0 ? capacity : 1), nDim(-1),
+	head(0), tail(0), stopping(false)
+{
+	writer = std::thread(&AsyncSink::writerLoop, this);
+}
+
+AsyncSink::~AsyncSink() {
+	stopping.store(true);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+	}
+	dataReady.notify_one();
+	writer.join();
+	target->flush();
+}
+
+void AsyncSink::record(double t, const double z[], int nDim) {
+	unsigned long long h = head.load(std::memory_order_relaxed);
+	if (this->nDim < 0) {
+		/// First record: size the ring. The writer reads nDim only after
+		/// seeing head move, which orders it after this write.
+		this->nDim = nDim;
+		ring.resize((size_t) capacity * (nDim + 1));
+	}
+
+	/// Wait for room:
+	if (h - tail.load(std::memory_order_acquire) >= (unsigned long long) capacity) {
+		std::unique_lock<std::mutex> lock(mutex);
+		dataReady.notify_one();
+		spaceReady.wait(lock, [&] {
+			return h - tail.load(std::memory_order_acquire) < (unsigned long long) capacity;
+		});
+	}
+
+	double *slot = &ring[(size_t) (h % capacity) * (nDim + 1)];
+	slot[0] = t;
+	std::memcpy(slot + 1, z, nDim * sizeof(double));
+	head.store(h + 1, std::memory_order_release);
+
+	/// Wake the writer once a batch is waiting:
+	if ((h + 1) % ASYNC_BATCH == 0) {
+		dataReady.notify_one();
+	}
+}
+
+void AsyncSink::writerLoop() {
+	for (;;) {
+		unsigned long long t = tail.load(std::memory_order_relaxed);
+		unsigned long long h = head.load(std::memory_order_acquire);
+		if (h == t) {
+			if (stopping.load()) {
+				return;
+			}
+			std::unique_lock<std::mutex> lock(mutex);
+			spaceReady.notify_all();
+			dataReady.wait_for(lock, std::chrono::milliseconds(10));
+			continue;
+		}
+
+		/// Pass on everything that is there, one batch at a time:
+		for (; t < h; t++) {
+			const double *slot = &ring[(size_t) (t % capacity) * (nDim + 1)];
+			target->record(slot[0], slot + 1, nDim);
+			if ((t + 1) % ASYNC_BATCH == 0) {
+				tail.store(t + 1, std::memory_order_release);
+				spaceReady.notify_all();
+			}
+		}
+		tail.store(h, std::memory_order_release);
+		spaceReady.notify_all();
+	}
+}
+
+void AsyncSink::flush() {
+	unsigned long long h = head.load();
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		dataReady.notify_one();
+		spaceReady.wait(lock, [&] { return tail.load(std::memory_order_acquire) >= h; });
+	}
+	target->flush();
+}
+
+void AsyncSink::resume(double t) {
+	flush();
+	target->resume(t);
+}
@@ -0,0 +1,110 @@
+#ifndef __SINK_H__
+#define __SINK_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Prints the current time and state to the log file */
+void printState(std::ofstream& file, double t, const double z[], int nDim);
+
+/* Receives the trajectory of a simulation, one (t, z) record per step.
+ * simulate writes to one of these instead of a fixed file, so independent
+ * runs can each have their own output. */
+class TrajectorySink {
+public:
+	virtual ~TrajectorySink() {}
+	virtual void record(double t, const double z[], int nDim) = 0;
+
+	/* Called by the simulation drivers once the run is over */
+	virtual void flush() {}
+
+	/* Called when a run continues from time t (see checkpoint.h), before
+	 * its next record: a sink that still holds records of an earlier run
+	 * drops those after t, which the run is about to write again. Only
+	 * BinarySink in append mode keeps any. */
+	virtual void resume(double) {}
+};
+
+/* Writes the trajectory as text, one "t, z[0], z[1], ..." line per record,
+ * with the given number of significant digits. The file is written through
+ * a 1 MB buffer. */
+class CsvSink : public TrajectorySink {
+public:
+	explicit CsvSink(const std::string& fileName, int precision = 6);
+	void record(double t, const double z[], int nDim);
+	void flush();
+
+private:
+	std::vector<char> buffer;
+	std::ofstream file;
+};
+
+/* Discards the trajectory */
+class NullSink : public TrajectorySink {
+public:
+	void record(double, const double[], int) {}
+};
+
+/* Passes on every k-th record (and the last one, at flush) to another sink */
+class DecimatedSink : public TrajectorySink {
+public:
+	DecimatedSink(TrajectorySink& target, int every);
+	void record(double t, const double z[], int nDim);
+	void flush();
+	void resume(double t) { target.resume(t); }
+
+private:
+	TrajectorySink& target;
+	int every;
+	long long count;
+	bool lastKept;              // was the latest record passed on?
+	double tLast;
+	std::vector<double> zLast;
+};
+
+/* Moves the work of another sink (formatting, file I/O) off the integration
+ * thread. record() only copies (t, z) into a bounded ring buffer; a
+ * background thread drains it into the target sink in large batches. When
+ * the buffer is full, record() waits for the writer to catch up. */
+class AsyncSink : public TrajectorySink {
+public:
+	/* capacity = number of records the ring buffer holds */
+	explicit AsyncSink(std::unique_ptr<TrajectorySink> target, int capacity = 4096);
+	~AsyncSink();
+
+	void record(double t, const double z[], int nDim);
+
+	/* Waits until every record so far has reached the target, then flushes it */
+	void flush();
+
+	/* Likewise, then passes it on */
+	void resume(double t);
+
+private:
+	AsyncSink(const AsyncSink&);
+	AsyncSink& operator=(const AsyncSink&);
+
+	void writerLoop();
+
+	std::unique_ptr<TrajectorySink> target;
+	int capacity;
+	int nDim;                     // set by the first record
+	std::vector<double> ring;     // capacity slots of (t, z[0], ..., z[nDim-1])
+
+	std::atomic<unsigned long long> head;   // records written by record()
+	std::atomic<unsigned long long> tail;   // records passed to the target
+	std::atomic<bool> stopping;
+
+	std::mutex mutex;
+	std::condition_variable dataReady;
+	std::condition_variable spaceReady;
+	std::thread writer;
+};
+
+#endif
@@ -0,0 +1,116 @@
+#include <stdexcept>
+#include <utility>
+
+#include "sparsity.h"
+
+SparsityPattern::SparsityPattern(int nDim, const std::vector<int>& row, const std::vector<int>& col) :
+	n(nDim), kl(0), ku(0)
+{
+	if (row.size() != col.size()) {
+		throw std::invalid_argument("SparsityPattern: row and col lists differ in length");
+	}
+	std::vector<std::pair<int, int> > entries;   // (column, row), sorted into columns
+	entries.reserve(row.size() + n);
+	for (size_t k = 0; k < row.size(); k++) {
+		if (row[k] < 0 || row[k] >= n || col[k] < 0 || col[k] >= n) {
+			throw std::out_of_range("SparsityPattern: entry outside the matrix");
+		}
+		entries.push_back(std::make_pair(col[k], row[k]));
+	}
+	for (int i = 0; i < n; i++) {
+		entries.push_back(std::make_pair(i, i));
+	}
+	std::sort(entries.begin(), entries.end());
+	entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+
+	start.assign(n + 1, 0);
+	rows.resize(entries.size());
+	for (size_t k = 0; k < entries.size(); k++) {
+		int j = entries[k].first, i = entries[k].second;
+		start[j + 1]++;
+		rows[k] = i;
+		kl = std::max(kl, i - j);
+		ku = std::max(ku, j - i);
+	}
+	for (int j = 0; j < n; j++) {
+		start[j + 1] += start[j];
+	}
+}
+
+SparsityPattern SparsityPattern::banded(int nDim, int lower, int upper) {
+	std::vector<int> row, col;
+	for (int j = 0; j < nDim; j++) {
+		for (int i = std::max(0, j - upper); i <= std::min(nDim - 1, j + lower); i++) {
+			row.push_back(i);
+			col.push_back(j);
+		}
+	}
+	return SparsityPattern(nDim, row, col);
+}
+
+ColumnColoring colorColumns(const SparsityPattern& pattern) {
+	int n = pattern.size();
+
+	/// The columns of each row (the pattern transposed):
+	std::vector<int> rowStart(n + 1, 0), rowCols(pattern.nonZeros());
+	for (int k = 0; k < pattern.nonZeros(); k++) {
+		rowStart[pattern.row(k) + 1]++;
+	}
+	for (int i = 0; i < n; i++) {
+		rowStart[i + 1] += rowStart[i];
+	}
+	std::vector<int> fill(rowStart.begin(), rowStart.end() - 1);
+	for (int j = 0; j < n; j++) {
+		for (int k = pattern.columnStart(j); k < pattern.columnStart(j + 1); k++) {
+			rowCols[fill[pattern.row(k)]++] = j;
+		}
+	}
+
+	/// Greedy: the lowest color no earlier neighbour has
+	std::vector<int> color(n, -1), taken(n + 1, -1);   // taken[c] == j: c is used next to j
+	int nColor = 0;
+	for (int j = 0; j < n; j++) {
+		for (int k = pattern.columnStart(j); k < pattern.columnStart(j + 1); k++) {
+			int i = pattern.row(k);
+			for (int e = rowStart[i]; e < rowStart[i + 1]; e++) {
+				int c = color[rowCols[e]];
+				if (c >= 0) {
+					taken[c] = j;
+				}
+			}
+		}
+		int c = 0;
+		while (taken[c] == j) {
+			c++;
+		}
+		color[j] = c;
+		nColor = std::max(nColor, c + 1);
+	}
+
+	/// Group the columns by color:
+	ColumnColoring coloring;
+	coloring.colors = nColor;
+	coloring.start.assign(nColor + 1, 0);
+	coloring.cols.resize(n);
+	for (int j = 0; j < n; j++) {
+		coloring.start[color[j] + 1]++;
+	}
+	for (int c = 0; c < nColor; c++) {
+		coloring.start[c + 1] += coloring.start[c];
+	}
+	fill.assign(coloring.start.begin(), coloring.start.end() - 1);
+	for (int j = 0; j < n; j++) {
+		coloring.cols[fill[color[j]]++] = j;
+	}
+	return coloring;
+}
+
+double SparseMatrix::operator()(int i, int j) const {
+	int kBegin = pattern->columnStart(j), kEnd = pattern->columnStart(j + 1);
+	for (int k = kBegin; k < kEnd; k++) {
+		if (pattern->row(k) == i) {
+			return values[k];
+		}
+	}
+	return 0.0;
+}
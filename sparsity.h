@@ -0,0 +1,135 @@
+#ifndef __SPARSITY_H__
+#define __SPARSITY_H__
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+/* Sparse Jacobians of dynFun(t, z, dz), for large systems (method of lines)
+ * in which each dz[i] depends on a few z[j] only.
+ *
+ * The user declares which entries can be nonzero in a SparsityPattern.
+ * colorColumns() then groups the columns so that no two columns of a group
+ * have a nonzero in the same row: perturbing all of a group's components
+ * at once still separates their effects, so a finite-difference Jacobian
+ * costs one dynamics call per group (color) instead of one per component.
+ * A 1-D stencil of width w needs w calls, whatever nDim is.
+ *
+ * The result goes into a SparseMatrix (compressed sparse columns, the input
+ * format of the usual sparse LU packages) or, with the implicit methods
+ * (ImplicitOptions::sparsity, see implicit.h), into their Newton matrix. */
+
+/* Where a Jacobian J(i, j) = d dz[i] / d z[j] can be nonzero. Compressed
+ * sparse columns: the rows of column j are row(k) for k = columnStart(j)
+ * ... columnStart(j + 1) - 1, in increasing order. */
+class SparsityPattern {
+public:
+	SparsityPattern() : n(0), kl(0), ku(0) {}
+
+	/* From a list of entries (row[k], col[k]), in any order; repeats are
+	 * merged. The diagonal is always included. */
+	SparsityPattern(int nDim, const std::vector<int>& row, const std::vector<int>& col);
+
+	/* Every entry with -lower <= j - i <= upper */
+	static SparsityPattern banded(int nDim, int lower, int upper);
+
+	int size() const { return n; }
+	int nonZeros() const { return (int) rows.size(); }
+	int columnStart(int j) const { return start[j]; }
+	int row(int k) const { return rows[k]; }
+
+	/* Bandwidths: largest i - j and j - i of the entries */
+	int lower() const { return kl; }
+	int upper() const { return ku; }
+
+private:
+	int n;
+	int kl;
+	int ku;
+	std::vector<int> start;   // n + 1 column offsets
+	std::vector<int> rows;
+};
+
+/* Columns grouped by color: the columns of color c are column(k) for
+ * k = colorStart(c) ... colorStart(c + 1) - 1 */
+class ColumnColoring {
+public:
+	ColumnColoring() : colors(0) {}
+
+	int nColor() const { return colors; }
+	int colorStart(int c) const { return start[c]; }
+	int column(int k) const { return cols[k]; }
+
+private:
+	friend ColumnColoring colorColumns(const SparsityPattern& pattern);
+
+	int colors;
+	std::vector<int> start;
+	std::vector<int> cols;
+};
+
+/* Greedy coloring, in column order: each column takes the lowest color not
+ * used by a column it shares a row with. Gives the optimal lower + upper + 1
+ * colors for a banded pattern. */
+ColumnColoring colorColumns(const SparsityPattern& pattern);
+
+/* Jacobian values on a pattern, in compressed sparse columns: entry k of
+ * the pattern (row pattern->row(k)) holds values[k]. The pattern is not
+ * owned. */
+class SparseMatrix {
+public:
+	explicit SparseMatrix(const SparsityPattern& pattern) :
+		pattern(&pattern), values(pattern.nonZeros(), 0.0) {}
+
+	/* Element (i, j): zero outside the pattern */
+	double operator()(int i, int j) const;
+
+	const SparsityPattern *pattern;
+	std::vector<double> values;
+};
+
+/* The finite-difference Jacobian of dynFun at (t, z), one dynamics call per
+ * color (plus one at z). Each entry goes to store(k, i, j, value), where k
+ * is its index in the pattern. f0, f1 and zp are scratch of size nDim;
+ * f0 is left holding dynFun(t, z). */
+template <class Dyn, class Store>
+void coloredDifferences(Dyn& dynFun, double t, double z[], const SparsityPattern& pattern,
+                        const ColumnColoring& coloring, double f0[], double f1[], double zp[],
+                        Store store)
+{
+	const double eps = std::numeric_limits<double>::epsilon();
+	int n = pattern.size();
+	dynFun(t, z, f0);
+	std::copy(z, z + n, zp);
+	for (int c = 0; c < coloring.nColor(); c++) {
+		int kBegin = coloring.colorStart(c), kEnd = coloring.colorStart(c + 1);
+		for (int k = kBegin; k < kEnd; k++) {
+			int j = coloring.column(k);
+			zp[j] = z[j] + std::sqrt(eps * std::max(1e-5, std::fabs(z[j])));
+		}
+		dynFun(t, zp, f1);
+		for (int k = kBegin; k < kEnd; k++) {
+			int j = coloring.column(k);
+			double d = zp[j] - z[j];
+			for (int e = pattern.columnStart(j); e < pattern.columnStart(j + 1); e++) {
+				int i = pattern.row(e);
+				store(e, i, j, (f1[i] - f0[i]) / d);
+			}
+			zp[j] = z[j];
+		}
+	}
+}
+
+/* J = df/dz at (t, z), by colored finite differences */
+template <class Dyn>
+void sparseJacobian(Dyn& dynFun, double t, double z[], const ColumnColoring& coloring,
+                    SparseMatrix& J)
+{
+	int n = J.pattern->size();
+	std::vector<double> f0(n), f1(n), zp(n);
+	coloredDifferences(dynFun, t, z, *J.pattern, coloring, f0.data(), f1.data(), zp.data(),
+		[&](int k, int, int, double value) { J.values[k] = value; });
+}
+
+#endif
@@ -0,0 +1,382 @@
+#ifndef __STEPPER_H__
+#define __STEPPER_H__
+
+#include "simd.h"
+#include "threadpool.h"
+
+/* Every step function takes the dynamics as a template parameter, so any
+ * callable with the shape of DynFun works:  dynFun(t, z, dz)  writes the
+ * state derivative dz[] at time t and state z[]. Function pointers, functors
+ * and lambdas (which can carry model parameters) are all accepted, and small
+ * right-hand sides inline into the stage loops. */
+
+typedef void (*DynFun)(double, double[], double[]);
+
+class ImplicitSolver;
+
+enum IntegrationMethod {
+	Euler,
+	MidPoint,
+	RungeKutta,
+	RK_2,
+	RK_4A,
+	RK_4B,
+	RK_45,
+	RK_5,
+	RK_10,
+	RK_DP5,
+	StormerVerlet,    // symplectic, for z = [q; p] (see symplectic.h)
+	Yoshida4,
+	Yoshida6,
+	Yoshida8,
+	BlanesMoan,
+	SDIRK_3,          // implicit, for stiff systems (see implicit.h)
+	RADAU_5,
+	BDF_2,
+	BDF_5,
+	LSRK_3,           // low-storage, for very large states (see lowstorage.h)
+	LSRK_4,
+	SSPRK_3,
+	ARK_4,            // implicit-explicit, for split stiff/non-stiff dynamics (see imex.h)
+	SSPRK_4           // low-storage; last, as files store these numbers
+};
+
+/* Scratch memory for the step functions. Every stage time, stage state and
+ * stage derivative lives in one contiguous, cache-line-aligned block that is
+ * allocated once (simulate creates one per run) and then reused by each step,
+ * so the time-stepping loop never touches the heap.
+ * nDim = dimension of the state space
+ * nStage = largest number of stages that will be requested from it */
+class StepperWorkspace {
+public:
+	StepperWorkspace(int nDim, int nStage);
+	~StepperWorkspace();
+
+	int nDim() const { return dim; }
+	int nStage() const { return stages; }
+
+	double* t() { return tBuf; }                              // stage times
+	double* z(int iStage) { return zBuf + iStage * stride; }  // stage states
+	double* f(int iStage) { return fBuf + iStage * stride; }  // stage derivatives
+	double* const* fList() { return fPtr; }                   // {f(0), f(1), ...}
+
+	/* Optional thread pool: large-state stage updates are split across it */
+	ThreadPool* pool() { return threads; }
+	void setPool(ThreadPool* pool) { threads = pool; }
+
+	/* First-same-as-last stage reuse. The last stage of an FSAL method is
+	 * evaluated at the new solution itself, so it is also the first stage of
+	 * the next step. Such a step ends with setLastStage(tUpp, iStage); the
+	 * next one calls reuseLastStage(tLow, zLow), which copies f(iStage) into
+	 * f(0) and returns true if the step starts at that time from the same
+	 * state as stage iStage (compared value by value). Any other step calls
+	 * clearLastStage. firstStageReused() tells whether the latest step saved
+	 * its first evaluation. */
+	void setLastStage(double t, int iStage) { lastTime = t; lastStage = iStage; }
+	void clearLastStage() { lastStage = -1; reused = false; }
+	bool reuseLastStage(double t, const double zLow[]);
+	bool firstStageReused() const { return reused; }
+
+	/* The FSAL record itself: stage index (-1: none) and time */
+	int lastStageIndex() const { return lastStage; }
+	double lastStageTime() const { return lastTime; }
+
+	/* Newton matrices and history of the implicit methods (owned; created
+	 * by their first step, see implicit.h) */
+	ImplicitSolver* implicitSolver() { return solver; }
+	void setImplicitSolver(ImplicitSolver* newSolver);
+
+private:
+	StepperWorkspace(const StepperWorkspace&);
+	StepperWorkspace& operator=(const StepperWorkspace&);
+
+	int dim;
+	int stages;
+	int stride;     // nDim rounded up to a whole number of cache lines
+	char* block;    // owning pointer returned by new[]
+	double* tBuf;
+	double* zBuf;
+	double* fBuf;
+	double** fPtr;
+	ThreadPool* threads;   // not owned
+	double lastTime;       // FSAL record, see setLastStage
+	int lastStage;         // -1: none
+	bool reused;
+	ImplicitSolver* solver;   // owned
+};
+
+/* Number of stages of each method. For the explicit tableaus this is also
+ * their dynamics calls per step (one fewer on an FSAL step of RK_DP5 that
+ * picks up where the previous one ended), but not for the others: the
+ * symplectic methods count only their kicks, the implicit ones call the
+ * dynamics once per Newton iteration, and BDF_2 / BDF_5 report the stages
+ * of the RADAU_5 steps they start with. Real call counts come from
+ * CountedDynamics (profile.h). */
+int methodStageCount(IntegrationMethod method);
+
+/* Number of stages to allocate in a StepperWorkspace for a method: its
+ * stage count, except for the low-storage methods, which need one, and
+ * ARK_4, which keeps two derivatives per stage */
+int methodWorkspaceStages(IntegrationMethod method);
+
+/* Name of the enum value, e.g. "RK_45" */
+const char* methodName(IntegrationMethod method);
+
+/* True for the symplectic methods of symplectic.h */
+bool isSymplectic(IntegrationMethod method);
+
+/* True for the implicit methods of implicit.h and imex.h */
+bool isImplicit(IntegrationMethod method);
+
+/* True for the low-storage methods of lowstorage.h */
+bool isLowStorage(IntegrationMethod method);
+
+/* True for the methods whose step may be given zUpp == zLow (the 2N
+ * low-storage methods): the drivers then keep one copy of the state */
+bool stepsInPlace(IntegrationMethod method);
+
+/* True if a tableau is first-same-as-last: its last stage is taken at tUpp
+ * with the solution weights, i.e. at the new solution itself */
+inline bool isFsalTableau(const double A[], const double B[], const double C[], int nStage) {
+	if (nStage < 2 || A[nStage-1] != 1.0 || C[nStage-1] != 0.0) {
+		return false;
+	}
+	const double *lastRow = &B[(nStage-1)*(nStage-2)/2];
+	for (int j = 0; j < nStage - 1; j++) {
+		if (lastRow[j] != C[j]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* out = base + dt * sum_j w[j] * f[j] for a large state (see stageCombine),
+ * split across the workspace's thread pool when it has one */
+inline void combineStages(StepperWorkspace& work, double out[], const double base[], double dt,
+                          const double w[], const double* const f[], int nTerm, int nDim)
+{
+	ThreadPool *pool = work.pool();
+	if (pool) {
+		pool->parallelFor(nDim, PARALLEL_CHUNK, [&](int iBegin, int iEnd) {
+			stageCombineRange(out, base, dt, w, f, nTerm, iBegin, iEnd);
+		});
+	} else {
+		stageCombine(out, base, dt, w, f, nTerm, nDim);
+	}
+}
+
+
+/******************************************************************************
+ *                     Hard-Coded Low-Order Methods                           *
+ ******************************************************************************/
+
+/* Takes a simple euler step for the system */
+template <class Dyn>
+void eulerStep(Dyn& dynFun, double t0, double t1, double z0[], double z1[], int nDim,
+               StepperWorkspace& work) {
+
+	double dt = t1 - t0;
+	double *dz = work.f(0);
+
+	work.clearLastStage();
+	dynFun(t0, z0, dz);
+
+	for (int i = 0; i < nDim; i++) {
+		z1[i] = z0[i] + dt * dz[i];
+	}
+
+}
+
+
+/* Time step using the mid-point method */
+template <class Dyn>
+void midPointStep(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+                  StepperWorkspace& work) {
+
+	double dt = tUpp - tLow;
+
+	/// Stage 0
+	double t0 = tLow;
+	double *z0 = zLow;
+	double *f0 = work.f(0);
+	work.clearLastStage();
+	dynFun(t0, z0, f0);
+
+	/// Stage 1
+	double t1 = t0 + 0.5 * dt;
+	double *z1 = work.z(1);
+	double *f1 = work.f(1);
+	for (int i = 0; i < nDim; i++) {
+		z1[i] = z0[i] + 0.5 * dt * f0[i];
+	}
+	dynFun(t1, z1, f1);
+
+	/// Collect Stages:
+	for (int i = 0; i < nDim; i++) {
+		zUpp[i] = zLow[i] + dt * f1[i];
+	}
+
+}
+
+
+/* Time step using 4th-order "Classical" Runge Kutta */
+template <class Dyn>
+void rungeKuttaStep(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+                    StepperWorkspace& work) {
+
+	double dt = tUpp - tLow;
+
+	/// Stage 0
+	double t0 = tLow;
+	double *z0 = zLow;
+	double *f0 = work.f(0);
+	work.clearLastStage();
+	dynFun(t0, z0, f0);
+
+	/// Stage 1
+	double t1 = t0 + 0.5 * dt;
+	double *z1 = work.z(1);
+	double *f1 = work.f(1);
+	for (int i = 0; i < nDim; i++) {
+		z1[i] = zLow[i] + 0.5 * dt * f0[i];
+	}
+	dynFun(t1, z1, f1);
+
+	/// Stage 2
+	double t2 = t1;
+	double *z2 = work.z(2);
+	double *f2 = work.f(2);
+	for (int i = 0; i < nDim; i++) {
+		z2[i] = zLow[i] + 0.5 * dt * f1[i];
+	}
+	dynFun(t2, z2, f2);
+
+	/// Stage 3
+	double t3 = tLow + dt;
+	double *z3 = work.z(3);
+	double *f3 = work.f(3);
+	for (int i = 0; i < nDim; i++) {
+		z3[i] = zLow[i] + dt * f2[i];
+	}
+	dynFun(t3, z3, f3);
+
+	/// Collect Stages:
+	for (int i = 0; i < nDim; i++) {
+		zUpp[i] = zLow[i] + (dt / 6) * (f0[i] + 2.0 * f1[i] + 2.0 * f2[i] + f3[i]);
+	}
+
+}
+
+
+
+/******************************************************************************
+ *                      General-Form Runge-Kutta Step                         *
+ ******************************************************************************/
+
+
+/* General-Purpose Runge--Kutta integration step, using a Butcher table.
+ * tLow = time at beginning of the step
+ * tUpp = time at the end of the step
+ * zLow = state at the beginning of the step
+ * zUpp = state at the end of the step (unknown  --  Computed by this function)
+ * nDim = dimension of the state space
+  * A[] gives the time coefficients for the method
+ * B[] gives the state propagation coefficients (assume lower triangular matrix)
+ * C[] gives the solution coefficients for the method
+ * nStage = number of stages in the Runge--Kutta method
+ * work = scratch memory, with room for at least nStage stages of size nDim
+ * Look at the example code to understand formatting for these inputs.
+ */
+template <class Dyn>
+void RK_STEP(Dyn& dynFun,
+             double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+             const double A[], const double B[], const double C[], int nStage,
+             StepperWorkspace& work)
+{
+
+	/// Populate time grid:
+	double *t = work.t();
+	double dt = tUpp - tLow;
+	for (int iStage = 0; iStage < nStage; iStage++) {
+		t[iStage] = tLow + dt * A[iStage];
+	}
+
+	/// Dynamics at initial point (unless the last step left it behind):
+	bool fsal = isFsalTableau(A, B, C, nStage);
+	if (!(fsal && work.reuseLastStage(tLow, zLow))) {
+		dynFun(t[0], zLow, work.f(0));
+	}
+
+	/// March through each stage:
+	double* const* f = work.fList();
+	double sum;
+	int idx;
+	for (int iStage = 1; iStage < nStage; iStage++) {
+		double *z = work.z(iStage);
+		if (nDim >= SIMD_MIN_DIM) {
+			combineStages(work, z, zLow, dt, &B[iStage*(iStage-1)/2], f, iStage, nDim);
+			dynFun(t[iStage], z, work.f(iStage));
+			continue;
+		}
+		for (int iDim = 0; iDim < nDim; iDim++) {
+			sum = 0.0;
+			for (int j = 0; j < iStage; j++) {
+				idx = iStage*(iStage-1)/2 + j;   // Triangle numbers
+				sum = sum + B[idx]*work.f(j)[iDim];
+			}
+			z[iDim] = zLow[iDim] + dt * sum;
+		}
+		dynFun(t[iStage], z, work.f(iStage));
+	}
+
+	if (fsal) {
+		work.setLastStage(tUpp, nStage - 1);
+	} else {
+		work.clearLastStage();
+	}
+
+	/// Compute the final estimate:
+	if (nDim >= SIMD_MIN_DIM) {
+		combineStages(work, zUpp, zLow, dt, C, f, nStage, nDim);
+		return;
+	}
+	for (int iDim = 0; iDim < nDim; iDim++) {
+		sum = 0.0;
+		for (int iStage = 0; iStage < nStage; iStage++) {
+			sum = sum + C[iStage] * work.f(iStage)[iDim];
+		}
+		zUpp[iDim] = zLow[iDim] + dt * sum;
+	}
+}
+
+/* General-Purpose Runge--Kutta step with an embedded error estimate.
+ * Arguments match RK_STEP, plus:
+ * zErr = estimate of the local error in zUpp (computed by this function)
+ * E[] gives the error coefficients: solution weights C[] minus the weights
+ *     of the embedded lower-order method
+ */
+template <class Dyn>
+void RK_STEP_ERR(Dyn& dynFun,
+                 double tLow, double tUpp, double zLow[], double zUpp[], double zErr[], int nDim,
+                 const double A[], const double B[], const double C[], const double E[],
+                 int nStage, StepperWorkspace& work)
+{
+	RK_STEP(dynFun, tLow, tUpp, zLow, zUpp, nDim, A, B, C, nStage, work);
+
+	/// Error estimate from the stages that are already in the workspace:
+	double dt = tUpp - tLow;
+	if (nDim >= SIMD_MIN_DIM) {
+		combineStages(work, zErr, 0, dt, E, work.fList(), nStage, nDim);
+		return;
+	}
+	double sum;
+	for (int iDim = 0; iDim < nDim; iDim++) {
+		sum = 0.0;
+		for (int iStage = 0; iStage < nStage; iStage++) {
+			sum = sum + E[iStage] * work.f(iStage)[iDim];
+		}
+		zErr[iDim] = dt * sum;
+	}
+}
+
+#endif
@@ -0,0 +1,107 @@
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include "sweep.h"
+
+SinkFactory csvOutput(const std::string& fileName) {
+	return [fileName]() {
+		return std::unique_ptr<TrajectorySink>(new CsvSink(fileName));
+	};
+}
+
+SinkFactory binaryOutput(const std::string& fileName, IntegrationMethod method,
+                         double relTol, double absTol)
+{
+	return [=]() {
+		return std::unique_ptr<TrajectorySink>(new BinarySink(fileName, method, relTol, absTol));
+	};
+}
+
+/* Job queue of one thread. The owner takes from the front, thieves from the
+ * back, so the two rarely meet. Jobs are whole simulations, so a mutex per
+ * queue costs nothing measurable. */
+struct SweepQueue {
+	std::mutex mutex;
+	std::deque<int> jobs;
+
+	bool popFront(int& job) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (jobs.empty()) {
+			return false;
+		}
+		job = jobs.front();
+		jobs.pop_front();
+		return true;
+	}
+
+	bool popBack(int& job) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (jobs.empty()) {
+			return false;
+		}
+		job = jobs.back();
+		jobs.pop_back();
+		return true;
+	}
+};
+
+std::vector<SweepResult> runSweep(const std::vector<SweepJob>& jobs, int nThread) {
+	int nJob = (int) jobs.size();
+	if (nThread <= 0) {
+		nThread = std::thread::hardware_concurrency();
+	}
+	if (nThread <= 0) {
+		nThread = 1;
+	}
+	if (nThread > nJob) {
+		nThread = nJob > 0 ? nJob : 1;
+	}
+
+	std::vector<SweepResult> results(nJob);
+	std::vector<SweepQueue> queues(nThread);
+
+	/// Deal the jobs out in contiguous blocks:
+	for (int i = 0; i < nJob; i++) {
+		queues[(long long) i * nThread / nJob].jobs.push_back(i);
+	}
+
+	std::mutex errorMutex;
+	std::exception_ptr error;
+
+	auto worker = [&](int self) {
+		int job;
+		for (;;) {
+			bool found = queues[self].popFront(job);
+			for (int k = 1; !found && k < nThread; k++) {
+				found = queues[(self + k) % nThread].popBack(job);
+			}
+			if (!found) {
+				return;   // no job spawns another, so empty queues stay empty
+			}
+			try {
+				jobs[job](results[job]);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(errorMutex);
+				if (!error) {
+					error = std::current_exception();
+				}
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int i = 1; i < nThread; i++) {
+		threads.push_back(std::thread(worker, i));
+	}
+	worker(0);
+	for (size_t i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+	return results;
+}
@@ -0,0 +1,93 @@
+#ifndef __SWEEP_H__
+#define __SWEEP_H__
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "integrator.h"
+
+/* How a sweep job advances in time: nStep fixed steps, or the adaptive
+ * controller of simulateAdaptive with the given options. */
+struct StepPolicy {
+	bool adaptive;
+	int nStep;                 // fixed-step jobs
+	AdaptiveOptions options;   // adaptive jobs
+
+	static StepPolicy fixed(int nStep) {
+		StepPolicy policy;
+		policy.adaptive = false;
+		policy.nStep = nStep;
+		return policy;
+	}
+
+	static StepPolicy variable(const AdaptiveOptions& options) {
+		StepPolicy policy;
+		policy.adaptive = true;
+		policy.nStep = 0;
+		policy.options = options;
+		return policy;
+	}
+};
+
+/* What a finished job leaves behind */
+struct SweepResult {
+	std::vector<double> z1;   // final state
+	AdaptiveStats stats;      // adaptive jobs only (zero otherwise)
+};
+
+/* Creates the output sink of a job. It is called on the worker thread when
+ * the job starts, so only running jobs hold files open. */
+typedef std::function<std::unique_ptr<TrajectorySink>()> SinkFactory;
+
+/* Sink factory for a CSV file with the given name */
+SinkFactory csvOutput(const std::string& fileName);
+
+/* Sink factory for a binary trajectory file (trajectory.h) */
+SinkFactory binaryOutput(const std::string& fileName, IntegrationMethod method,
+                         double relTol = 0.0, double absTol = 0.0);
+
+/* One independent simulation. makeSweepJob builds these, keeping the type of
+ * the dynamics inside so that the right-hand side still inlines. */
+typedef std::function<void(SweepResult&)> SweepJob;
+
+/* Packages simulate / simulateAdaptive as a sweep job.
+ * makeSink = where the trajectory goes (empty: nowhere) */
+template <class Dyn>
+SweepJob makeSweepJob(Dyn dynFun, double t0, double t1, const std::vector<double>& z0,
+                      IntegrationMethod method, const StepPolicy& policy,
+                      SinkFactory makeSink = SinkFactory())
+{
+	return [=](SweepResult& result) {
+		std::unique_ptr<TrajectorySink> sink;
+		if (makeSink) {
+			sink = makeSink();
+		} else {
+			sink.reset(new NullSink());
+		}
+
+		int nDim = (int) z0.size();
+		std::vector<double> zInit(z0);
+		result.z1.assign(nDim, 0.0);
+		if (policy.adaptive) {
+			result.stats = simulateAdaptive(dynFun, t0, t1, zInit.data(), result.z1.data(),
+			                                nDim, method, policy.options, *sink);
+		} else {
+			simulate(dynFun, t0, t1, zInit.data(), result.z1.data(),
+			         nDim, policy.nStep, method, *sink);
+		}
+	};
+}
+
+/* Runs every job on nThread threads (<= 0: one per hardware thread) and
+ * returns their results in job order.
+ *
+ * Each thread starts with its own queue of jobs and works from the front of
+ * it. A thread whose queue runs dry steals from the back of the others, so
+ * a few long (e.g. tightly-toleranced adaptive) jobs do not leave the rest
+ * of the machine idle. If a job throws, the first exception is re-thrown
+ * once all threads have stopped. */
+std::vector<SweepResult> runSweep(const std::vector<SweepJob>& jobs, int nThread);
+
+#endif
@@ -0,0 +1,12 @@
+#include "symplectic.h"
+
+template void svStep<DynFun>(DynFun&, double, double, double[], double[], int,
+                             StepperWorkspace&);
+template void yoshida4Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                   StepperWorkspace&);
+template void yoshida6Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                   StepperWorkspace&);
+template void yoshida8Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                   StepperWorkspace&);
+template void bm4Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                              StepperWorkspace&);
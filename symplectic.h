@@ -0,0 +1,320 @@
+#ifndef __SYMPLECTIC_H__
+#define __SYMPLECTIC_H__
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+
+#include "profile.h"
+#include "stepper.h"
+
+/* Symplectic partitioned methods, for separable mechanical systems
+ *     dq/dt = v(t, p),    dp/dt = a(t, q)
+ * with the state stored as z = [q; p] (nDim = 2 * nPos). A step alternates
+ * kicks, p += K[i] dt a(q), and drifts, q += D[i] dt v(p):
+ *     kick K[0], drift D[0], kick K[1], ..., drift D[nDrift-1], kick K[nDrift]
+ * (kicks with K[i] = 0 are skipped). The flow they approximate is
+ * symplectic, so the energy error stays bounded however long the run,
+ * instead of drifting as it does with the Runge-Kutta methods.
+ *
+ * When the step both starts and ends with a kick, the last one is taken at
+ * the new positions, so its forces are also those of the first kick of the
+ * next step, which reuses them (see StepperWorkspace::setLastStage).
+ *
+ * The dynamics are best given split (see SplitDynamics): each kick and
+ * drift then evaluates only its own half. Any other dynamics function works
+ * too, if the rates of its first nPos components depend only on the last
+ * nPos and vice versa, but every kick and drift costs a full evaluation.
+ */
+
+/* Dynamics in split form. Also callable as an ordinary dynamics function,
+ * so the same object can be passed to every method. */
+template <class Drift, class Kick>
+struct SplitDynamics {
+	Drift drift;   // drift(t, p, dq): position rates, from the momenta (or velocities)
+	Kick kick;     // kick(t, q, dp): momentum rates (forces), from the positions
+	int nPos;      // number of positions: nDim = 2 * nPos
+
+	void operator()(double t, double z[], double dz[]) {
+		drift(t, z + nPos, dz);
+		kick(t, z, dz + nPos);
+	}
+};
+
+template <class Drift, class Kick>
+SplitDynamics<Drift, Kick> splitDynamics(Drift drift, Kick kick, int nPos) {
+	return SplitDynamics<Drift, Kick>{drift, kick, nPos};
+}
+
+/* Position rates at z = [q; p], into f[0 ... nPos-1] */
+template <class Dyn>
+inline void splitDrift(Dyn& dynFun, double t, double z[], double f[], int) {
+	dynFun(t, z, f);
+}
+
+template <class Drift, class Kick>
+inline void splitDrift(SplitDynamics<Drift, Kick>& dynFun, double t, double z[], double f[], int nPos) {
+	dynFun.drift(t, z + nPos, f);
+}
+
+/* Momentum rates at z = [q; p], into f[nPos ... 2*nPos-1] */
+template <class Dyn>
+inline void splitKick(Dyn& dynFun, double t, double z[], double f[], int) {
+	dynFun(t, z, f);
+}
+
+template <class Drift, class Kick>
+inline void splitKick(SplitDynamics<Drift, Kick>& dynFun, double t, double z[], double f[], int nPos) {
+	dynFun.kick(t, z, f + nPos);
+}
+
+/* ... seen through std::ref and the counting and instrumentation wrappers */
+template <class Dyn>
+inline void splitDrift(std::reference_wrapper<Dyn>& dynFun, double t, double z[], double f[], int nPos) {
+	splitDrift(dynFun.get(), t, z, f, nPos);
+}
+
+template <class Dyn>
+inline void splitKick(std::reference_wrapper<Dyn>& dynFun, double t, double z[], double f[], int nPos) {
+	splitKick(dynFun.get(), t, z, f, nPos);
+}
+
+template <class Dyn>
+inline void splitDrift(ProfiledDynamics<Dyn>& dynFun, double t, double z[], double f[], int nPos) {
+	PhaseTimer timer(dynFun.profiler, PhaseDynamics);
+	dynFun.profiler.summary.nEval++;
+	splitDrift(dynFun.dynFun, t, z, f, nPos);
+}
+
+template <class Dyn>
+inline void splitKick(ProfiledDynamics<Dyn>& dynFun, double t, double z[], double f[], int nPos) {
+	PhaseTimer timer(dynFun.profiler, PhaseDynamics);
+	dynFun.profiler.summary.nEval++;
+	splitKick(dynFun.dynFun, t, z, f, nPos);
+}
+
+template <class Dyn>
+inline void splitDrift(CountedDynamics<Dyn>& dynFun, double t, double z[], double f[], int nPos) {
+	dynFun.nEval++;
+	splitDrift(dynFun.dynFun, t, z, f, nPos);
+}
+
+template <class Dyn>
+inline void splitKick(CountedDynamics<Dyn>& dynFun, double t, double z[], double f[], int nPos) {
+	dynFun.nEval++;
+	splitKick(dynFun.dynFun, t, z, f, nPos);
+}
+
+/* Number of nonzero kicks: the force evaluations per step */
+template <class Tableau>
+constexpr int symplecticKickCount() {
+	int n = 0;
+	for (int i = 0; i <= Tableau::nDrift; i++) {
+		n += Tableau::K[i] != 0.0;
+	}
+	return n;
+}
+
+/* A symplectic step for a kick/drift tableau:
+ *
+ *     struct MyTableau {
+ *         static constexpr int nDrift = ...;
+ *         static constexpr double K[] = {...};   // kick weights [nDrift + 1]
+ *         static constexpr double D[] = {...};   // drift weights [nDrift]
+ *     };
+ *
+ * Arguments match RK_STEP. The workspace needs symplecticKickCount() stages
+ * (at least two). */
+template <class Tableau, class Dyn>
+void SYMPLECTIC_STEP(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+                     StepperWorkspace& work)
+{
+	const int nDrift = Tableau::nDrift;
+	static_assert(std::size(Tableau::K) == nDrift + 1, "K[] needs nDrift + 1 entries");
+	static_assert(std::size(Tableau::D) == nDrift, "D[] needs nDrift entries");
+	constexpr bool fsal = Tableau::K[0] != 0.0 && Tableau::K[nDrift] != 0.0;
+
+	if (nDim % 2 != 0) {
+		throw std::invalid_argument("symplectic methods need a state z = [q; p] of even size");
+	}
+	const int nPos = nDim / 2;
+	double dt = tUpp - tLow;
+	double *q = zUpp;
+	double *p = zUpp + nPos;
+	double *f = work.f(1);     // rates: positions in f[0, nPos), momenta in f[nPos, nDim)
+	double *fq = f;
+	double *fp = f + nPos;
+
+	std::copy(zLow, zLow + nDim, zUpp);
+	if (fsal && !work.reuseLastStage(tLow, zLow)) {
+		splitKick(dynFun, tLow, zUpp, f, nPos);
+	}
+
+	double t = tLow;   // time of the positions
+	for (int i = 0; i <= nDrift; i++) {
+		/// Kick:
+		if (Tableau::K[i] != 0.0) {
+			double h = Tableau::K[i] * dt;
+			for (int j = 0; j < nPos; j++) {
+				p[j] += h * fp[j];
+			}
+		}
+		if (i == nDrift) {
+			break;
+		}
+
+		/// Drift:
+		double h = Tableau::D[i] * dt;
+		splitDrift(dynFun, t, zUpp, f, nPos);
+		for (int j = 0; j < nPos; j++) {
+			q[j] += h * fq[j];
+		}
+		t = i == nDrift - 1 ? tUpp : t + h;
+		if (Tableau::K[i+1] != 0.0) {
+			splitKick(dynFun, t, zUpp, f, nPos);
+		}
+	}
+
+	/// The last forces were taken at the new positions:
+	if constexpr (fsal) {
+		std::copy(zUpp, zUpp + nDim, work.z(1));
+		work.setLastStage(tUpp, 1);
+	} else {
+		work.clearLastStage();
+	}
+}
+
+
+/******************************************************************************
+ *                              Tableaus                                      *
+ ******************************************************************************/
+
+/* Stormer-Verlet (velocity Verlet, kick-drift-kick), order 2 */
+struct SV__Tableau {
+	static constexpr int nDrift = 1;
+	static constexpr double K[] = {0.5, 0.5};
+	static constexpr double D[] = {1.0};
+};
+
+/* Yoshida's compositions of Stormer-Verlet: Verlet steps of sizes
+ * w_m dt, ..., w_1 dt, w_0 dt, w_1 dt, ..., w_m dt, written out as kicks
+ * and drifts (the half kicks of neighbouring Verlet steps merge).
+ * H. Yoshida, "Construction of higher order symplectic integrators",
+ * Phys. Lett. A 150 (1990) 262-268. */
+
+/* Order 4, the "triple jump": w1 = 1 / (2 - 2^(1/3)), w0 = 1 - 2 w1 */
+struct Yoshida4__Tableau {
+	static constexpr double w1 = 1.0 / (2.0 - 1.2599210498948731648);
+	static constexpr double w0 = 1.0 - 2.0 * w1;
+
+	static constexpr int nDrift = 3;
+	static constexpr double K[] = {
+		w1 / 2.0, (w1 + w0) / 2.0, (w0 + w1) / 2.0, w1 / 2.0
+	};
+	static constexpr double D[] = {w1, w0, w1};
+};
+
+/* Order 6, solution A */
+struct Yoshida6__Tableau {
+	static constexpr double w1 = -1.17767998417887;
+	static constexpr double w2 = 0.235573213359357;
+	static constexpr double w3 = 0.784513610477560;
+	static constexpr double w0 = 1.0 - 2.0 * (w1 + w2 + w3);
+
+	static constexpr int nDrift = 7;
+	static constexpr double K[] = {
+		w3 / 2.0, (w3 + w2) / 2.0, (w2 + w1) / 2.0, (w1 + w0) / 2.0,
+		(w0 + w1) / 2.0, (w1 + w2) / 2.0, (w2 + w3) / 2.0, w3 / 2.0
+	};
+	static constexpr double D[] = {w3, w2, w1, w0, w1, w2, w3};
+};
+
+/* Order 8, solution A */
+struct Yoshida8__Tableau {
+	static constexpr double w1 = -1.61582374150097;
+	static constexpr double w2 = -2.44699182370524;
+	static constexpr double w3 = -0.716989419708120e-2;
+	static constexpr double w4 = 2.44002732616735;
+	static constexpr double w5 = 0.157739928123617;
+	static constexpr double w6 = 1.82020630970714;
+	static constexpr double w7 = 1.04242620869991;
+	static constexpr double w0 = 1.0 - 2.0 * (w1 + w2 + w3 + w4 + w5 + w6 + w7);
+
+	static constexpr int nDrift = 15;
+	static constexpr double K[] = {
+		w7 / 2.0, (w7 + w6) / 2.0, (w6 + w5) / 2.0, (w5 + w4) / 2.0,
+		(w4 + w3) / 2.0, (w3 + w2) / 2.0, (w2 + w1) / 2.0, (w1 + w0) / 2.0,
+		(w0 + w1) / 2.0, (w1 + w2) / 2.0, (w2 + w3) / 2.0, (w3 + w4) / 2.0,
+		(w4 + w5) / 2.0, (w5 + w6) / 2.0, (w6 + w7) / 2.0, w7 / 2.0
+	};
+	static constexpr double D[] = {w7, w6, w5, w4, w3, w2, w1, w0, w1, w2, w3, w4, w5, w6, w7};
+};
+
+/* Blanes-Moan optimized partitioned RK, 6 stages, order 4 (S6 of
+ * S. Blanes, P.C. Moan, "Practical symplectic partitioned Runge-Kutta and
+ * Runge-Kutta-Nystrom methods", J. Comput. Appl. Math. 142 (2002) 313-330).
+ * Seven drifts around six kicks: the zero first and last kicks are skipped. */
+struct BM4__Tableau {
+	static constexpr double a1 = 0.0792036964311957;
+	static constexpr double a2 = 0.353172906049774;
+	static constexpr double a3 = -0.0420650803577195;
+	static constexpr double a4 = 1.0 - 2.0 * (a1 + a2 + a3);
+	static constexpr double b1 = 0.209515106613362;
+	static constexpr double b2 = -0.143851773179818;
+	static constexpr double b3 = 0.5 - b1 - b2;
+
+	static constexpr int nDrift = 7;
+	static constexpr double K[] = {0.0, b1, b2, b3, b3, b2, b1, 0.0};
+	static constexpr double D[] = {a1, a2, a3, a4, a3, a2, a1};
+};
+
+
+/******************************************************************************
+ *                           Step Functions                                   *
+ ******************************************************************************/
+
+/* Arguments as for the other step functions; the state is z = [q; p] */
+template <class Dyn>
+void svStep(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+            StepperWorkspace& work) {
+	SYMPLECTIC_STEP<SV__Tableau>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work);
+}
+
+template <class Dyn>
+void yoshida4Step(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+                  StepperWorkspace& work) {
+	SYMPLECTIC_STEP<Yoshida4__Tableau>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work);
+}
+
+template <class Dyn>
+void yoshida6Step(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+                  StepperWorkspace& work) {
+	SYMPLECTIC_STEP<Yoshida6__Tableau>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work);
+}
+
+template <class Dyn>
+void yoshida8Step(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+                  StepperWorkspace& work) {
+	SYMPLECTIC_STEP<Yoshida8__Tableau>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work);
+}
+
+template <class Dyn>
+void bm4Step(Dyn& dynFun, double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+             StepperWorkspace& work) {
+	SYMPLECTIC_STEP<BM4__Tableau>(dynFun, tLow, tUpp, zLow, zUpp, nDim, work);
+}
+
+/* Compiled once, in symplectic.cpp, for plain function pointers */
+extern template void svStep<DynFun>(DynFun&, double, double, double[], double[], int,
+                                    StepperWorkspace&);
+extern template void yoshida4Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                          StepperWorkspace&);
+extern template void yoshida6Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                          StepperWorkspace&);
+extern template void yoshida8Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                          StepperWorkspace&);
+extern template void bm4Step<DynFun>(DynFun&, double, double, double[], double[], int,
+                                     StepperWorkspace&);
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef __TABLEAU_H__
+#define __TABLEAU_H__
+
+#include <iterator>
+
+#include "stepper.h"
+
+/* Compile-time specialization of RK_STEP.
+ *
+ * A tableau is a type that holds the same coefficients RK_STEP takes as
+ * arguments, all of them constexpr:
+ *
+ *     struct MyTableau {
+ *         static constexpr int nStage = ...;
+ *         static constexpr double A[] = {...};   // time coefficients [nStage]
+ *         static constexpr double B[] = {...};   // lower triangle, row by row
+ *         static constexpr double C[] = {...};   // solution weights [nStage]
+ *         static constexpr double E[] = {...};   // error weights (optional)
+ *     };
+ *
+ * RK_STEP_FIXED<MyTableau> unrolls the stage loops, folds every coefficient
+ * into the arithmetic and drops the terms whose coefficient is exactly zero,
+ * so each method compiles into its own step kernel. Tableaus that are only
+ * known at run time should go through RK_STEP instead.
+ *
+ * For large states (nDim >= SIMD_MIN_DIM) the sums go to the vectorized
+ * stageCombine kernels instead (see combineStages), which skip the same zero
+ * terms at run time.
+ */
+
+/* Which set of tableau weights a sum runs over */
+enum TableauWeights { TableauB, TableauC, TableauE };
+
+template <class Tableau, int Weights, int k>
+constexpr double tableauWeight() {
+	if constexpr (Weights == TableauB) {
+		return Tableau::B[k];
+	} else if constexpr (Weights == TableauC) {
+		return Tableau::C[k];
+	} else {
+		return Tableau::E[k];
+	}
+}
+
+/* Adds w[offset + j] * f[j][iDim] for j = first ... nTerm-1, skipping the
+ * terms with a zero weight. Callers start the sum at -0.0, which (unlike
+ * +0.0) is an exact identity for addition, so the compiler drops it too. */
+template <class Tableau, int Weights, int offset, int first, int nTerm>
+inline double fixedWeightedSum(double sum, double* const f[], int iDim) {
+	if constexpr (first == nTerm) {
+		return sum;
+	} else {
+		constexpr double w = tableauWeight<Tableau, Weights, offset + first>();
+		if constexpr (w != 0.0) {
+			sum = sum + w * f[first][iDim];
+		}
+		return fixedWeightedSum<Tableau, Weights, offset, first + 1, nTerm>(sum, f, iDim);
+	}
+}
+
+/* Computes stage iStage and every stage after it */
+template <class Tableau, int iStage, class Dyn>
+inline void fixedStages(Dyn& dynFun, double tLow, double dt, double zLow[], int nDim,
+                        StepperWorkspace& work, double* const z[], double* const f[]) {
+	if constexpr (iStage < Tableau::nStage) {
+		const int row = iStage * (iStage - 1) / 2;   // Triangle numbers
+		double *zi = z[iStage];
+		if (nDim >= SIMD_MIN_DIM) {
+			combineStages(work, zi, zLow, dt, Tableau::B + row, f, iStage, nDim);
+		} else {
+			for (int iDim = 0; iDim < nDim; iDim++) {
+				zi[iDim] = zLow[iDim] + dt *
+					fixedWeightedSum<Tableau, TableauB, row, 0, iStage>(-0.0, f, iDim);
+			}
+		}
+		dynFun(tLow + dt * Tableau::A[iStage], zi, f[iStage]);
+		fixedStages<Tableau, iStage + 1>(dynFun, tLow, dt, zLow, nDim, work, z, f);
+	}
+}
+
+/* isFsalTableau, at compile time */
+template <class Tableau>
+constexpr bool tableauIsFsal() {
+	const int n = Tableau::nStage;
+	if (n < 2 || Tableau::A[n-1] != 1.0 || Tableau::C[n-1] != 0.0) {
+		return false;
+	}
+	for (int j = 0; j < n - 1; j++) {
+		if (Tableau::B[(n-1)*(n-2)/2 + j] != Tableau::C[j]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Runs every stage of the method, leaving the stage derivatives in work.
+ * An FSAL tableau takes its first stage from the previous step when it can
+ * (see StepperWorkspace::reuseLastStage). */
+template <class Tableau, class Dyn>
+inline void fixedAllStages(Dyn& dynFun, double tLow, double tUpp, double zLow[], int nDim,
+                           StepperWorkspace& work, double* f[]) {
+	const int nStage = Tableau::nStage;
+	static_assert(std::size(Tableau::A) == nStage, "A[] needs nStage entries");
+	static_assert(std::size(Tableau::B) == nStage * (nStage - 1) / 2,
+	              "B[] needs the nStage*(nStage-1)/2 entries of the lower triangle");
+	static_assert(std::size(Tableau::C) == nStage, "C[] needs nStage entries");
+
+	double *z[nStage];
+	for (int iStage = 0; iStage < nStage; iStage++) {
+		z[iStage] = work.z(iStage);
+		f[iStage] = work.f(iStage);
+	}
+
+	double dt = tUpp - tLow;
+	constexpr bool fsal = tableauIsFsal<Tableau>();
+	if (!(fsal && work.reuseLastStage(tLow, zLow))) {
+		dynFun(tLow + dt * Tableau::A[0], zLow, f[0]);
+	}
+	fixedStages<Tableau, 1>(dynFun, tLow, dt, zLow, nDim, work, z, f);
+	if constexpr (fsal) {
+		work.setLastStage(tUpp, nStage - 1);
+	} else {
+		work.clearLastStage();
+	}
+}
+
+/* RK_STEP for a compile-time tableau. Arguments match RK_STEP. */
+template <class Tableau, class Dyn>
+void RK_STEP_FIXED(Dyn& dynFun,
+                   double tLow, double tUpp, double zLow[], double zUpp[], int nDim,
+                   StepperWorkspace& work)
+{
+	const int nStage = Tableau::nStage;
+	double *f[nStage];
+	fixedAllStages<Tableau>(dynFun, tLow, tUpp, zLow, nDim, work, f);
+
+	/// Compute the final estimate:
+	double dt = tUpp - tLow;
+	if (nDim >= SIMD_MIN_DIM) {
+		combineStages(work, zUpp, zLow, dt, Tableau::C, f, nStage, nDim);
+		return;
+	}
+	for (int iDim = 0; iDim < nDim; iDim++) {
+		zUpp[iDim] = zLow[iDim] + dt *
+			fixedWeightedSum<Tableau, TableauC, 0, 0, nStage>(-0.0, f, iDim);
+	}
+}
+
+/* RK_STEP_ERR for a compile-time tableau, which must also define E[].
+ * Arguments match RK_STEP_ERR. */
+template <class Tableau, class Dyn>
+void RK_STEP_FIXED_ERR(Dyn& dynFun,
+                       double tLow, double tUpp, double zLow[], double zUpp[], double zErr[],
+                       int nDim, StepperWorkspace& work)
+{
+	const int nStage = Tableau::nStage;
+	static_assert(std::size(Tableau::E) == nStage, "E[] needs nStage entries");
+	double *f[nStage];
+	fixedAllStages<Tableau>(dynFun, tLow, tUpp, zLow, nDim, work, f);
+
+	/// Compute the final estimate and its error:
+	double dt = tUpp - tLow;
+	if (nDim >= SIMD_MIN_DIM) {
+		combineStages(work, zUpp, zLow, dt, Tableau::C, f, nStage, nDim);
+		combineStages(work, zErr, 0, dt, Tableau::E, f, nStage, nDim);
+		return;
+	}
+	for (int iDim = 0; iDim < nDim; iDim++) {
+		zUpp[iDim] = zLow[iDim] + dt *
+			fixedWeightedSum<Tableau, TableauC, 0, 0, nStage>(-0.0, f, iDim);
+		zErr[iDim] = dt *
+			fixedWeightedSum<Tableau, TableauE, 0, 0, nStage>(-0.0, f, iDim);
+	}
+}
+
+#endif
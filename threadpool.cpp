@@ -0,0 +1,90 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(int nThread) :
+	nThread(nThread), generation(0), pending(0), stopping(false),
+	task(0), context(0), n(0), chunk(1)
+{
+	if (this->nThread <= 0) {
+		this->nThread = std::thread::hardware_concurrency();
+	}
+	if (this->nThread <= 0) {
+		this->nThread = 1;
+	}
+
+	/// The calling thread takes share 0, the workers the rest:
+	for (int i = 1; i < this->nThread; i++) {
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+}
+
+/* Runs the chunks that belong to thread iThread: the same contiguous run of
+ * chunks on every call with the same n and chunk size. */
+void ThreadPool::runShare(int iThread) {
+	int nChunk = (n + chunk - 1) / chunk;
+	int first = (int) ((long long) nChunk * iThread / nThread);
+	int last = (int) ((long long) nChunk * (iThread + 1) / nThread);
+	for (int c = first; c < last; c++) {
+		int iBegin = c * chunk;
+		int iEnd = iBegin + chunk < n ? iBegin + chunk : n;
+		task(context, iBegin, iEnd);
+	}
+}
+
+void ThreadPool::run(Task task, void* context, int n, int chunk) {
+	if (nThread == 1 || n <= chunk) {
+		task(context, 0, n);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->task = task;
+		this->context = context;
+		this->n = n;
+		this->chunk = chunk;
+		pending = nThread - 1;
+		generation++;
+	}
+	wake.notify_all();
+
+	runShare(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this] { return pending == 0; });
+}
+
+void ThreadPool::workerLoop(int iThread) {
+	unsigned long seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return stopping || generation != seen; });
+			if (stopping) {
+				return;
+			}
+			seen = generation;
+		}
+
+		runShare(iThread);
+
+		bool last;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			last = (--pending == 0);
+		}
+		if (last) {
+			done.notify_one();
+		}
+	}
+}
@@ -0,0 +1,70 @@
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/* Size of the index ranges handed to each thread, in doubles: 64 KB, so a
+ * chunk of every stage buffer it touches stays in the L2 cache. */
+const int PARALLEL_CHUNK = 8192;
+
+/* A fixed set of worker threads, created once and reused for every
+ * parallelFor, so that per-stage work does not pay for thread start-up.
+ *
+ * parallelFor splits [0, n) into chunks and gives each thread the same
+ * contiguous run of chunks on every call. Every stage update and every
+ * chunked dynamics call of a run therefore touches the same part of the
+ * state from the same core. */
+class ThreadPool {
+public:
+	/* nThread = total number of threads, including the calling thread
+	 * (<= 0: one per hardware thread) */
+	explicit ThreadPool(int nThread);
+	~ThreadPool();
+
+	int size() const { return nThread; }
+
+	/* Calls body(iBegin, iEnd) for every chunk of [0, n), in parallel, and
+	 * returns when all of them are done. */
+	template <class Body>
+	void parallelFor(int n, int chunk, Body&& body) {
+		typedef typename std::remove_reference<Body>::type BodyType;
+		run(&callBody<BodyType>, const_cast<void*>(static_cast<const void*>(&body)), n, chunk);
+	}
+
+private:
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+
+	typedef void (*Task)(void*, int, int);
+
+	template <class Body>
+	static void callBody(void* body, int iBegin, int iEnd) {
+		(*static_cast<Body*>(body))(iBegin, iEnd);
+	}
+
+	void run(Task task, void* context, int n, int chunk);
+	void runShare(int iThread);
+	void workerLoop(int iThread);
+
+	int nThread;
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	unsigned long generation;   // bumped once per parallelFor
+	int pending;                // workers still busy with this generation
+	bool stopping;
+
+	/// Current job:
+	Task task;
+	void* context;
+	int n;
+	int chunk;
+};
+
+#endif
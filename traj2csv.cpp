@@ -0,0 +1,22 @@
+/* traj2csv: converts a binary trajectory file (trajectory.h) to CSV, for
+ * MAIN_readDataLog.m and other text-based tools.
+ *
+ *     ./traj2csv.out [logFile.traj [logFile.csv]]
+ */
+
+#include <exception>
+#include <iostream>
+
+#include "trajectory.h"
+
+int main(int argc, char* argv[]) {
+	std::string inName = argc > 1 ? argv[1] : "logFile.traj";
+	std::string outName = argc > 2 ? argv[2] : "logFile.csv";
+	try {
+		trajectoryToCsv(inName, outName);
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,240 @@
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "byteorder.h"
+#include "trajectory.h"
+
+static const char TRAJECTORY_MAGIC[8] = {'R', 'K', 'T', 'R', 'A', 'J', 0, 0};
+
+
+/******************************************************************************
+ *                              BinarySink                                    *
+ ******************************************************************************/
+
+BinarySink::BinarySink(const std::string& fileName, IntegrationMethod method,
+                       double relTol, double absTol) :
+	BinarySink(fileName, method, SinkCreate, relTol, absTol)
+{
+}
+
+BinarySink::BinarySink(const std::string& fileName, IntegrationMethod method, BinarySinkMode mode,
+                       double relTol, double absTol) :
+	file(0), buffer(1 << 20), method(method), relTol(relTol), absTol(absTol), nDim(-1),
+	headerSize(TRAJECTORY_HEADER_SIZE)
+{
+	if (mode == SinkAppend) {
+		file = std::fopen(fileName.c_str(), "r+b");
+		if (!file && errno != ENOENT) {
+			throw std::runtime_error("BinarySink: cannot open " + fileName);
+		}
+	}
+	if (file) {
+		std::setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+		openToAppend(fileName);
+		return;
+	}
+	file = std::fopen(fileName.c_str(), "wb");
+	if (!file) {
+		throw std::runtime_error("BinarySink: cannot open " + fileName);
+	}
+	std::setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+}
+
+/* Checks the header of the file to continue, and leaves the file position
+ * after its last complete record */
+void BinarySink::openToAppend(const std::string& fileName) {
+	unsigned char header[TRAJECTORY_HEADER_SIZE];
+	size_t nRead = std::fread(header, 1, sizeof(header), file);
+	fseeko(file, 0, SEEK_END);
+	long long size = (long long) ftello(file);
+	long long end = 0;
+	if (size > 0) {
+		uint32_t nDimRaw = nRead == sizeof(header) ? getU32(header + 12) : 0;
+		headerSize = nRead == sizeof(header) ? getU32(header + 20) : 0;
+		if (nRead < sizeof(header) || std::memcmp(header, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) != 0
+		    || getU32(header + 8) != (uint32_t) TRAJECTORY_VERSION
+		    || headerSize < TRAJECTORY_HEADER_SIZE || headerSize % 8 != 0 || headerSize > size
+		    || nDimRaw >= (uint32_t) INT_MAX) {
+			std::fclose(file);
+			throw std::runtime_error("BinarySink: " + fileName + " is not a trajectory file");
+		}
+		if ((IntegrationMethod) getU32(header + 16) != method) {
+			std::fclose(file);
+			throw std::runtime_error("BinarySink: " + fileName + " was written with another method");
+		}
+
+		/// Keep the complete records (a file without any gets a new header):
+		if (nDimRaw > 0) {
+			nDim = (int) nDimRaw;
+			long long recordSize = (long long) sizeof(double) * (nDim + 1);
+			end = headerSize + (size - headerSize) / recordSize * recordSize;
+		}
+	}
+	if (end < size && ftruncate(fileno(file), (off_t) end) != 0) {
+		std::fclose(file);
+		throw std::runtime_error("BinarySink: cannot truncate " + fileName);
+	}
+	if (nDim < 0) {
+		headerSize = TRAJECTORY_HEADER_SIZE;
+	}
+	fseeko(file, (off_t) end, SEEK_SET);
+}
+
+BinarySink::~BinarySink() {
+	if (nDim < 0) {
+		writeHeader(0);
+	}
+	std::fclose(file);
+}
+
+void BinarySink::writeHeader(int nDim) {
+	unsigned char header[TRAJECTORY_HEADER_SIZE];
+	std::memset(header, 0, sizeof(header));
+	std::memcpy(header, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC));
+	putU32(header + 8, TRAJECTORY_VERSION);
+	putU32(header + 12, nDim);
+	putU32(header + 16, (uint32_t) method);
+	putU32(header + 20, TRAJECTORY_HEADER_SIZE);
+	putF64(header + 24, relTol);
+	putF64(header + 32, absTol);
+	std::fwrite(header, 1, sizeof(header), file);
+	this->nDim = nDim;
+}
+
+void BinarySink::record(double t, const double z[], int nDim) {
+	if (this->nDim < 0) {
+		writeHeader(nDim);
+	} else if (nDim != this->nDim) {
+		throw std::invalid_argument("BinarySink: record does not match the nDim of the file");
+	}
+	if (!BIG_ENDIAN_HOST) {
+		std::fwrite(&t, sizeof(double), 1, file);
+		std::fwrite(z, sizeof(double), nDim, file);
+	} else {
+		row.resize(nDim + 1);
+		row[0] = swapBytes(t);
+		for (int i = 0; i < nDim; i++) {
+			row[i + 1] = swapBytes(z[i]);
+		}
+		std::fwrite(row.data(), sizeof(double), nDim + 1, file);
+	}
+}
+
+void BinarySink::flush() {
+	std::fflush(file);
+}
+
+void BinarySink::resume(double t) {
+	if (nDim < 0) {
+		return;
+	}
+	std::fflush(file);
+	fseeko(file, 0, SEEK_END);
+	long long end = (long long) ftello(file);
+
+	/// Walk back over the records after t (no more than were written since
+	/// the last flush, if the sink is flushed at every checkpoint):
+	long long recordSize = (long long) sizeof(double) * (nDim + 1);
+	while (end - recordSize >= headerSize) {
+		unsigned char bytes[sizeof(double)];
+		if (pread(fileno(file), bytes, sizeof(bytes), (off_t) (end - recordSize)) != (ssize_t) sizeof(bytes)) {
+			throw std::runtime_error("BinarySink: cannot read back the trajectory");
+		}
+		if (!(getF64(bytes) > t)) {
+			break;
+		}
+		end -= recordSize;
+	}
+	if (ftruncate(fileno(file), (off_t) end) != 0) {
+		throw std::runtime_error("BinarySink: cannot truncate the trajectory");
+	}
+	fseeko(file, (off_t) end, SEEK_SET);
+}
+
+
+/******************************************************************************
+ *                            TrajectoryFile                                  *
+ ******************************************************************************/
+
+TrajectoryFile::TrajectoryFile(const std::string& fileName) :
+	mapping(0), mapSize(0), records(0), dim(0), count(0),
+	integrationMethod(Euler), rTol(0.0), aTol(0.0)
+{
+	if (BIG_ENDIAN_HOST) {
+		throw std::runtime_error("TrajectoryFile: records cannot be mapped on a big-endian host");
+	}
+
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("TrajectoryFile: cannot open " + fileName);
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size < TRAJECTORY_HEADER_SIZE) {
+		close(fd);
+		throw std::runtime_error("TrajectoryFile: " + fileName + " is not a trajectory file");
+	}
+	mapSize = info.st_size;
+	mapping = mmap(0, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		mapping = 0;
+		throw std::runtime_error("TrajectoryFile: cannot map " + fileName);
+	}
+
+	/// Check and read the header:
+	const unsigned char* header = static_cast<const unsigned char*>(mapping);
+	uint32_t headerSize = getU32(header + 20);
+	if (std::memcmp(header, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) != 0 ||
+	    getU32(header + 8) != (uint32_t) TRAJECTORY_VERSION ||
+	    headerSize < (uint32_t) TRAJECTORY_HEADER_SIZE || headerSize % 8 != 0 ||
+	    headerSize > mapSize) {
+		munmap(mapping, mapSize);
+		mapping = 0;
+		throw std::runtime_error("TrajectoryFile: " + fileName + " is not a trajectory file");
+	}
+	/// nDim must give a record size that fits; 0 only for a sink that
+	/// was closed before its first record:
+	uint32_t nDimRaw = getU32(header + 12);
+	bool empty = mapSize == headerSize;
+	if ((nDimRaw == 0 && !empty) || nDimRaw >= (uint32_t) INT_MAX
+	    || (size_t) nDimRaw + 1 > SIZE_MAX / sizeof(double)) {
+		munmap(mapping, mapSize);
+		mapping = 0;
+		throw std::runtime_error("TrajectoryFile: " + fileName + " is not a trajectory file");
+	}
+	dim = (int) nDimRaw;
+	integrationMethod = (IntegrationMethod) getU32(header + 16);
+	rTol = getF64(header + 24);
+	aTol = getF64(header + 32);
+
+	/// A partly written last record is ignored:
+	records = reinterpret_cast<const double*>(header + headerSize);
+	count = (long long) ((mapSize - headerSize) / (sizeof(double) * ((size_t) dim + 1)));
+}
+
+TrajectoryFile::~TrajectoryFile() {
+	if (mapping) {
+		munmap(mapping, mapSize);
+	}
+}
+
+
+/******************************************************************************
+ *                            CSV Conversion                                  *
+ ******************************************************************************/
+
+void trajectoryToCsv(const std::string& inName, const std::string& outName) {
+	TrajectoryFile in(inName);
+	CsvSink out(outName, 17);
+	for (long long i = 0; i < in.nRecord(); i++) {
+		out.record(in.time(i), in.state(i), in.nDim());
+	}
+}
@@ -0,0 +1,113 @@
+#ifndef __TRAJECTORY_H__
+#define __TRAJECTORY_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "sink.h"
+#include "stepper.h"
+
+/* Binary trajectory files.
+ *
+ * Layout (all numbers little-endian):
+ *     bytes  0 -  7   magic "RKTRAJ\0\0"
+ *     bytes  8 - 11   uint32 format version (1)
+ *     bytes 12 - 15   uint32 nDim
+ *     bytes 16 - 19   int32  IntegrationMethod
+ *     bytes 20 - 23   uint32 header size in bytes (64)
+ *     bytes 24 - 31   double relTol (0 for fixed-step runs)
+ *     bytes 32 - 39   double absTol (0 for fixed-step runs)
+ *     bytes 40 - 63   reserved, zero
+ * followed by one record per step of nDim+1 doubles: t, z[0], ..., z[nDim-1].
+ *
+ * The file is only ever appended to, so the record count is the file size
+ * (a run that dies leaves every complete record readable). Records start on
+ * an 8-byte boundary, so a mapped file can be read in place as doubles.
+ */
+
+const int TRAJECTORY_VERSION = 1;
+const int TRAJECTORY_HEADER_SIZE = 64;
+
+/* How BinarySink opens its file */
+enum BinarySinkMode {
+	SinkCreate,   // a new file, replacing any old one
+	SinkAppend    // add to the file of an earlier run (a new file if none)
+};
+
+/* Writes the trajectory in the binary format above. The header is written
+ * with the first record, once nDim is known.
+ *
+ * In append mode the sink continues an existing file, for a run resumed
+ * from a checkpoint: it must have been written with the same method
+ * (std::runtime_error otherwise), a partly written last record is dropped,
+ * and the new records must have the file's nDim (std::invalid_argument).
+ * resume(t) then drops the records after t. */
+class BinarySink : public TrajectorySink {
+public:
+	BinarySink(const std::string& fileName, IntegrationMethod method,
+	           double relTol = 0.0, double absTol = 0.0);
+	BinarySink(const std::string& fileName, IntegrationMethod method, BinarySinkMode mode,
+	           double relTol = 0.0, double absTol = 0.0);
+	~BinarySink();
+
+	void record(double t, const double z[], int nDim);
+	void flush();
+	void resume(double t);
+
+private:
+	BinarySink(const BinarySink&);
+	BinarySink& operator=(const BinarySink&);
+
+	void writeHeader(int nDim);
+	void openToAppend(const std::string& fileName);
+
+	FILE* file;
+	std::vector<char> buffer;
+	IntegrationMethod method;
+	double relTol;
+	double absTol;
+	int nDim;                   // -1 until the header is written
+	long long headerSize;       // bytes before the first record
+	std::vector<double> row;    // byte-swapped record, big-endian hosts only
+};
+
+/* Read-only view of a binary trajectory file. The file is memory-mapped:
+ * state() points straight into the mapping, so nothing is copied or parsed
+ * until it is used. Throws std::runtime_error if the file cannot be opened
+ * or is not a trajectory file. */
+class TrajectoryFile {
+public:
+	explicit TrajectoryFile(const std::string& fileName);
+	~TrajectoryFile();
+
+	int nDim() const { return dim; }
+	long long nRecord() const { return count; }
+	IntegrationMethod method() const { return integrationMethod; }
+	double relTol() const { return rTol; }
+	double absTol() const { return aTol; }
+
+	/* Time and state of record i (0 <= i < nRecord()) */
+	double time(long long i) const { return records[i * (dim + 1)]; }
+	const double* state(long long i) const { return records + i * (dim + 1) + 1; }
+
+private:
+	TrajectoryFile(const TrajectoryFile&);
+	TrajectoryFile& operator=(const TrajectoryFile&);
+
+	void* mapping;
+	size_t mapSize;
+	const double* records;
+	int dim;
+	long long count;
+	IntegrationMethod integrationMethod;
+	double rTol;
+	double aTol;
+};
+
+/* Writes a binary trajectory file out as CSV, in the layout of CsvSink,
+ * with every digit needed to read the numbers back exactly. */
+void trajectoryToCsv(const std::string& inName, const std::string& outName);
+
+#endif